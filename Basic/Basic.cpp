@@ -4,190 +4,188 @@
  * This file is the starter project for the BASIC interpreter.
  */
 
+#include <algorithm>
 #include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
 #include "exp.hpp"
+#include "imagecache.hpp"
+#include "loader.hpp"
+#include "memstats.hpp"
+#include "sampler.hpp"
 #include "parser.hpp"
 #include "program.hpp"
 #include "Utils/error.hpp"
-#include "Utils/tokenScanner.hpp"
+#include "Utils/lexer.hpp"
 #include "Utils/strlib.hpp"
 #include <string>
 
 /* Function prototypes */
 
-void processLine(std::string line, Program &program, EvalState &state);
+bool processLine(std::string line, Program &program, EvalState &state);
 
-void legal(const std::string &word);
-
-int find_cmp(const std::string &in);
+void usage(const char *progname);
 
 /* Main program */
 
-int main() {
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--memstats") == 0) enableMemoryAccounting();
+    }
     EvalState state;
     Program program(state);
-    while (true) {
+    std::vector<std::string> files;
+    std::string cache;
+    std::string flame;
+    Sampler sampler;
+    bool stats = false;
+    bool memstats = false;
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--load" && i + 1 < argc) {
+            files.push_back(argv[++i]);
+        } else if (option == "--cache" && i + 1 < argc) {
+            cache = argv[++i];
+        } else if (option == "--stats") {
+            stats = true;
+        } else if (option == "--memstats") {
+            memstats = true;
+        } else if (option == "--flame" && i + 1 < argc) {
+            flame = argv[++i];
+            program.sampler = &sampler;
+        } else if (option == "--profile") {
+            program.profiling = true;
+        } else if (option == "--jit") {
+            program.engine = JIT_ENGINE;
+        } else if (option == "--tree") {
+            program.engine = TREE_ENGINE;
+        } else if (option == "--vm") {
+            program.engine = VM_ENGINE;
+        } else if (option == "--tier-threshold" && i + 1 < argc) {
+            program.tierThreshold = std::max(1, atoi(argv[++i]));
+        } else if (option == "--line-buffered") {
+            program.output.setPolicy(LINE_BUFFERED);
+        } else if (option == "--block-buffered") {
+            program.output.setPolicy(BLOCK_BUFFERED);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    for (const std::string &file: files) {
+        try {
+            if (cache.empty()) {
+                loadProgram(file, program, state);
+            } else {
+                loadProgramCached(file, cache, program, state);
+            }
+        } catch (ErrorException &ex) {
+            std::cerr << argv[0] << ": " << ex.getMessage() << '\n';
+            return 1;
+        }
+    }
+    bool running = true;
+    while (running) {
         try {
             std::string input;
             getline(std::cin, input);
             if (input.empty())
-                return 0;
-            processLine(input, program, state);
+                break;
+            running = processLine(input, program, state);
         } catch (ErrorException &ex) {
-            std::cout << ex.getMessage() << std::endl;
+            program.output.write(ex.getMessage() + '\n');
+            program.output.flush();
         }
     }
+    program.output.flush();
+    if (stats) {
+        program.reportMemory(std::cerr);
+        program.reportPromotions(std::cerr);
+        program.reportCompiles(std::cerr);
+    }
+    if (program.profiling) program.reportProfile(std::cerr);
+    if (memstats) program.reportHeap(std::cerr);
+    if (!flame.empty()) {
+        std::ofstream out(flame);
+        sampler.write(out);
+        if (!out) std::cerr << argv[0] << ": cannot write " << flame << '\n';
+    }
     return 0;
 }
 
+/*
+ * Function: usage
+ * Usage: usage(argv[0]);
+ * ----------------------
+ * Describes the command-line options on the error stream and exits.
+ */
+
+void usage(const char *progname) {
+    std::cerr << "Usage: " << progname << " [--load FILE]... [--cache DIR] [--tree | --vm | --jit] [--tier-threshold N] [--stats] [--memstats] [--profile] [--flame FILE] [--line-buffered | --block-buffered]\n"
+              << "    --load FILE       Add the numbered lines of FILE to the program before reading commands\n"
+              << "    --cache DIR       Keep parsed images of loaded files in DIR and reuse them while a file is unchanged\n"
+              << "    --tree            Run programs with the tree walker only\n"
+              << "    --vm              Compile programs to bytecode for the VM before running them\n"
+              << "    --jit             Compile programs without INPUT to native x86-64 code\n"
+              << "    --tier-threshold N\n"
+              << "                      Promote a loop to compiled code after N backward jumps (default 1000)\n"
+              << "    --stats           Report memory use and loop promotions on the error stream at exit\n"
+              << "    --memstats        Report heap use by category and its peak on the error stream at exit\n"
+              << "    --profile         Run programs on the profiling tree walker and report time per line at exit\n"
+              << "    --flame FILE      Sample where programs spend time and write folded stacks to FILE at exit\n"
+              << "    --line-buffered   Write output line by line (default when stdout is a terminal)\n"
+              << "    --block-buffered  Write output in blocks (default when stdout is a pipe or file)\n";
+    exit(1);
+}
+
 /*
  * Function: processLine
  * Usage: processLine(line, program, state);
  * -----------------------------------------
- * Processes a single line entered by the user.  In this version of
- * implementation, the program reads a line, parses it as an expression,
- * and then prints the result.  In your implementation, you will
- * need to replace this method with one that can respond correctly
- * when the user enters a program line (which begins with a number)
- * or one of the BASIC commands, such as LIST or RUN.
+ * Processes a single line entered by the user.  A line that begins
+ * with a number is stored in the program, or deletes the line with
+ * that number if nothing follows it.  Any other line is a command and
+ * is carried out immediately.  Returns false once the user has asked
+ * to quit.
  */
 
-void processLine(std::string line, Program &program, EvalState &state) {
-    TokenScanner scanner;
-    scanner.ignoreWhitespace();
-    scanner.scanNumbers();
-    scanner.setInput(line);
-    std::string first_token = scanner.nextToken();
-    if (scanner.getTokenType(first_token) == NUMBER) {
-        int line_number = stringToInteger(first_token);
-        if (line_number < 0) {
-            throw ErrorException("SYNTAX ERROR");
+bool processLine(std::string line, Program &program, EvalState &state) {
+    ParsedLine parsed = program.parse(line);
+    if (parsed.lineNumber >= 0) {
+        if (parsed.statement) {
+            program.addSourceLine(parsed.lineNumber, line, parsed.statement);
+        } else {
+            program.removeSourceLine(parsed.lineNumber);
         }
-        std::string second_token = scanner.nextToken();
-        if (second_token == "REM") {
-            program.addSourceLine(line_number, line, REM);
-        } else if (second_token == "LET") {
-            std::string word = scanner.nextToken();
-            if (scanner.getTokenType(word) != WORD || scanner.nextToken() != "=") {
-                throw ErrorException("SYNTAX ERROR");
-            }
-            legal(word);
-            program.addSourceLine(line_number, line, LET);
-        } else if (second_token == "PRINT") {
-            if (!scanner.hasMoreTokens()) {
-                throw ErrorException("SYNTAX ERROR");
-            }
-            program.addSourceLine(line_number, line, PRINT);
-        } else if (second_token == "INPUT") {
-            std::string word = scanner.nextToken();
-            legal(word);
-            if (scanner.getTokenType(word) != WORD ||
-                scanner.getTokenType(scanner.nextToken()) != TokenType(EOF)) {
-                throw ErrorException("SYNTAX ERROR");
-            }
-            program.addSourceLine(line_number, line, INPUT);
-        } else if (second_token == "END") {
-            if (scanner.getTokenType(scanner.nextToken()) != TokenType(EOF)) {
-                throw ErrorException("SYNTAX ERROR");
-            }
-            program.addSourceLine(line_number, line, END);
-        } else if (second_token == "GOTO") {
-            if (scanner.getTokenType(scanner.nextToken()) != NUMBER ||
-                scanner.getTokenType(scanner.nextToken()) != TokenType(EOF)) {
-                throw ErrorException("SYNTAX ERROR");
-            }
-            program.addSourceLine(line_number, line, GOTO);
-        } else if (second_token == "IF") {
-            if (find_cmp(line) == -1) {
-                throw ErrorException("SYNTAX ERROR");
-            }
-            bool find_then = false, find_line = false, no_ap = false;
-            while (scanner.hasMoreTokens()) {
-                if (scanner.nextToken() == "THEN") {
-                    find_then = true;
-                    if (scanner.getTokenType(scanner.nextToken()) == NUMBER) {
-                        find_line = true;
-                        if (!scanner.hasMoreTokens()) {
-                            no_ap = true;
-                            break;
-                        }
-                    }
-                }
-            }
-            if (!(find_then && find_line && no_ap)) {
-                throw ErrorException("SYNTAX ERROR");
-            }
-            program.addSourceLine(line_number, line, IF);
-        } else if (second_token.empty()) {
-            program.removeSourceLine(line_number);
-        } else throw ErrorException("SYNTAX ERROR");
-    } else {
-        if (first_token == "RUN") {
-            if (scanner.hasMoreTokens()) {
-                throw ErrorException("SYNTAX ERROR");
-            }
+        return true;
+    }
+    switch (parsed.cmd) {
+        case RUN:
             program.Run();
-        } else if (first_token == "LIST") {
-            if (scanner.hasMoreTokens()) {
-                throw ErrorException("SYNTAX ERROR");
-            }
+            break;
+        case LIST:
             program.List();
-        } else if (first_token == "CLEAR") {
-            if (scanner.hasMoreTokens()) {
-                throw ErrorException("SYNTAX ERROR");
-            }
+            break;
+        case CLEAR:
             program.Clear();
             state.Clear();
-        } else if (first_token == "QUIT") {
-            if (scanner.hasMoreTokens()) {
-                throw ErrorException("SYNTAX ERROR");
-            }
-            exit(0);
-        } else if (first_token == "HELP") {
-            if (!scanner.nextToken().empty()) {
-                throw ErrorException("SYNTAX ERROR");
-            }
-            std::cout << "Yet another basic interpreter\n";
-        } else if (first_token == "LET") {
-            std::string word = scanner.nextToken();
-            legal(word);
-            if (scanner.getTokenType(word) != WORD || scanner.nextToken() != "=") {
-                throw ErrorException("SYNTAX ERROR");
-            }
-            program.addSourceLine(-1, line, LET);
-            program.getParsedStatement(-1)->execute(state, program);
-            program.line_now = -1;
-            program.removeSourceLine(-1);
-
-        } else if (first_token == "PRINT") {
-            if (!scanner.hasMoreTokens()) {
-                throw ErrorException("SYNTAX ERROR");
-            }
-            program.addSourceLine(-1, line, PRINT);
-            program.getParsedStatement(-1)->execute(state, program);
-            program.line_now = -1;
-            program.removeSourceLine(-1);
-        } else if (first_token == "INPUT") {
-            std::string word = scanner.nextToken();
-            legal(word);
-            bool a = scanner.getTokenType(word) != WORD, b = !scanner.nextToken().empty();
-            if (a || b) {
-                throw ErrorException("SYNTAX ERROR");
-            }
-            program.addSourceLine(-1, line, INPUT);
-            program.getParsedStatement(-1)->execute(state, program);
-            program.line_now = -1;
-            program.removeSourceLine(-1);
-        } else throw ErrorException("SYNTAX ERROR");
+            break;
+        case QUIT:
+            return false;
+        case PROFILE:
+            program.Profile();
+            break;
+        case MEMSTATS:
+            program.MemStats();
+            break;
+        case HELP:
+            program.output.write("Yet another basic interpreter\n");
+            break;
+        default:
+            program.execute(*parsed.statement);
     }
+    return true;
 }
-
-void legal(const std::string &word) {
-    if (word == "REM" || word == "LET" || word == "PRINT" || word == "INPUT" || word == "END" || word == "GOTO" ||
-        word == "IF" || word == "THEN" || word == "RUN" || word == "LIST" || word == "CLEAR" || word == "QUIT" ||
-        word == "HELP") {
-        error("SYNTAX ERROR");
-    }
-}
\ No newline at end of file
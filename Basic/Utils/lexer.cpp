@@ -0,0 +1,149 @@
+/*
+ * File: lexer.cpp
+ * ---------------
+ * Implementation for the Lexer class.
+ */
+
+#include <cctype>
+#include <climits>
+#include "error.hpp"
+#include "lexer.hpp"
+
+static bool isSpace(char ch) {
+    return isspace((unsigned char) ch) != 0;
+}
+
+static bool isDigit(char ch) {
+    return isdigit((unsigned char) ch) != 0;
+}
+
+static bool isWord(char ch) {
+    return isalnum((unsigned char) ch) != 0;
+}
+
+Lexer::Lexer(std::string_view input) {
+    setInput(input);
+}
+
+void Lexer::setInput(std::string_view input) {
+    this->input = input;
+    cursor = 0;
+    savedCount = 0;
+}
+
+/*
+ * Implementation notes: nextToken
+ * -------------------------------
+ * The token classes are the ones TokenScanner produces with
+ * whitespace ignored and numbers scanned: a number starts with a
+ * digit, a word is a run of letters and digits, and every other
+ * character is an operator token of its own.
+ */
+
+Token Lexer::nextToken() {
+    if (savedCount > 0) {
+        return saved[--savedCount];
+    }
+    int length = int(input.size());
+    while (cursor < length && isSpace(input[cursor])) cursor++;
+    int start = cursor;
+    if (start == length) {
+        return {input.substr(start, 0), TokenType(EOF), start};
+    }
+    char ch = input[start];
+    TokenType type;
+    if (isDigit(ch)) {
+        cursor = scanNumber(start);
+        type = NUMBER;
+    } else if (isWord(ch)) {
+        while (cursor < length && isWord(input[cursor])) cursor++;
+        type = WORD;
+    } else {
+        cursor++;
+        type = ch == '"' ? STRING : OPERATOR;
+    }
+    return {input.substr(start, cursor - start), type, start};
+}
+
+bool Lexer::hasMoreTokens() {
+    Token token = nextToken();
+    saveToken(token);
+    return !token.empty();
+}
+
+void Lexer::saveToken(const Token &token) {
+    if (savedCount == PUSHBACK) {
+        error("Lexer: too many saved tokens");
+    }
+    saved[savedCount++] = token;
+}
+
+int Lexer::getPosition() const {
+    if (savedCount > 0) return saved[savedCount - 1].position;
+    return cursor;
+}
+
+std::string_view Lexer::rest() const {
+    return input.substr(getPosition());
+}
+
+/*
+ * Implementation notes: scanNumber
+ * --------------------------------
+ * Follows the finite-state machine of TokenScanner::scanNumber: digits,
+ * an optional fraction and an optional exponent.  An exponent marker
+ * that is not followed by digits is not part of the number.
+ */
+
+int Lexer::scanNumber(int start) const {
+    int length = int(input.size());
+    int p = start;
+    while (p < length && isDigit(input[p])) p++;
+    if (p < length && input[p] == '.') {
+        p++;
+        while (p < length && isDigit(input[p])) p++;
+    }
+    if (p < length && (input[p] == 'E' || input[p] == 'e')) {
+        int q = p + 1;
+        if (q < length && (input[q] == '+' || input[q] == '-')) q++;
+        if (q < length && isDigit(input[q])) {
+            while (q < length && isDigit(input[q])) q++;
+            p = q;
+        }
+    }
+    return p;
+}
+
+/*
+ * Implementation notes: tokenToInteger
+ * ------------------------------------
+ * Accepts optional surrounding whitespace, an optional sign and a
+ * run of digits that fits in an int, which is what reading an int
+ * from an istringstream accepts.
+ */
+
+int tokenToInteger(std::string_view token) {
+    int length = int(token.size());
+    int p = 0;
+    while (p < length && isSpace(token[p])) p++;
+    bool negative = false;
+    if (p < length && (token[p] == '+' || token[p] == '-')) {
+        negative = token[p] == '-';
+        p++;
+    }
+    int digits = p;
+    long long value = 0;
+    bool overflow = false;
+    while (p < length && isDigit(token[p])) {
+        value = value * 10 + (token[p] - '0');
+        if (value > (long long) INT_MAX + 1) overflow = true, value = (long long) INT_MAX + 1;
+        p++;
+    }
+    bool valid = p > digits;
+    while (p < length && isSpace(token[p])) p++;
+    if (negative) value = -value;
+    if (!valid || p != length || overflow || value > INT_MAX || value < INT_MIN) {
+        error("stringToInteger: Illegal integer format (" + std::string(token) + ")");
+    }
+    return int(value);
+}
@@ -0,0 +1,163 @@
+#ifndef CODE_LEXER_HPP
+#define CODE_LEXER_HPP
+
+/*
+ * File: lexer.hpp
+ * ---------------
+ * This file exports a <code>Lexer</code> class that splits a line into
+ * tokens the same way a <code>TokenScanner</code> set up with
+ * <code>ignoreWhitespace</code> and <code>scanNumbers</code> does, but
+ * without copying: the input is a <code>std::string_view</code> and
+ * every token is a view into it.  Lexing a line performs no heap
+ * allocation.
+ */
+
+#include <string>
+#include <string_view>
+#include "tokenScanner.hpp"
+
+/*
+ * Type: Token
+ * -----------
+ * A token returned by a <code>Lexer</code>.  <code>text</code> points
+ * into the input of the lexer and is only valid as long as the input
+ * is.  At the end of the input the text is empty and the type is
+ * <code>TokenType(EOF)</code>.
+ */
+
+struct Token {
+    std::string_view text;
+    TokenType type;
+    int position;
+
+    bool operator==(std::string_view other) const {
+        return text == other;
+    }
+
+    bool operator!=(std::string_view other) const {
+        return text != other;
+    }
+
+    bool empty() const {
+        return text.empty();
+    }
+
+    std::string str() const {
+        return std::string(text);
+    }
+};
+
+/*
+ * Class: Lexer
+ * ------------
+ * The typical use of the <code>Lexer</code> class mirrors that of the
+ * <code>TokenScanner</code>:
+ *<pre>
+ *    Lexer lexer(line);
+ *    while (lexer.hasMoreTokens()) {
+ *       Token token = lexer.nextToken();
+ *       ... process the token ...
+ *    }
+ *</pre>
+ */
+
+class Lexer {
+
+public:
+
+/*
+ * Constructor: Lexer
+ * Usage: Lexer lexer;
+ *        Lexer lexer(str);
+ * ------------------------
+ * Initializes a lexer over the specified input, which must outlive
+ * the lexer and every token it returns.
+ */
+
+    Lexer() = default;
+
+    explicit Lexer(std::string_view input);
+
+/*
+ * Method: setInput
+ * Usage: lexer.setInput(str);
+ * ---------------------------
+ * Restarts the lexer on a new input and discards any saved tokens.
+ */
+
+    void setInput(std::string_view input);
+
+/*
+ * Method: nextToken
+ * Usage: Token token = lexer.nextToken();
+ * ---------------------------------------
+ * Returns the next token, or an empty EOF token at the end of the
+ * input.
+ */
+
+    Token nextToken();
+
+/*
+ * Method: hasMoreTokens
+ * Usage: if (lexer.hasMoreTokens()) ...
+ * -------------------------------------
+ * Returns <code>true</code> if there are additional tokens to read.
+ */
+
+    bool hasMoreTokens();
+
+/*
+ * Method: saveToken
+ * Usage: lexer.saveToken(token);
+ * ------------------------------
+ * Pushes a token back so that the next call to <code>nextToken</code>
+ * returns it again.  At most <code>PUSHBACK</code> tokens can be saved
+ * at a time.
+ */
+
+    void saveToken(const Token &token);
+
+/*
+ * Method: getPosition
+ * Usage: int pos = lexer.getPosition();
+ * -------------------------------------
+ * Returns the position of the next token in the input.
+ */
+
+    int getPosition() const;
+
+/*
+ * Method: rest
+ * Usage: std::string_view text = lexer.rest();
+ * --------------------------------------------
+ * Returns the part of the input that has not been read yet, starting
+ * with any saved token.
+ */
+
+    std::string_view rest() const;
+
+    static const int PUSHBACK = 4;
+
+private:
+
+    std::string_view input;
+    int cursor = 0;
+    Token saved[PUSHBACK];
+    int savedCount = 0;
+
+    int scanNumber(int start) const;
+
+};
+
+/*
+ * Function: tokenToInteger
+ * Usage: int value = tokenToInteger(token.text);
+ * ----------------------------------------------
+ * Converts a token to an integer.  It accepts and rejects exactly the
+ * strings <code>stringToInteger</code> does and reports the same error,
+ * but needs no stream and no copy.
+ */
+
+int tokenToInteger(std::string_view token);
+
+#endif //CODE_LEXER_HPP
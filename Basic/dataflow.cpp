@@ -0,0 +1,197 @@
+/*
+ * File: dataflow.cpp
+ * ------------------
+ * This file implements the DefiniteAssignment class.
+ */
+
+#include <algorithm>
+#include "dataflow.hpp"
+
+/*
+ * Implementation notes: instructions
+ * ----------------------------------
+ * A superinstruction stands at the place of the OP_LOAD it replaced
+ * and the rest of its sequence is still in the image, so the analysis
+ * reads the image through baseOf and sees the original instructions,
+ * which have the same effect and the same successors.
+ */
+
+static bool isBranch(OpCode op) {
+    return op == OP_JUMP || op == OP_JUMP_EQ || op == OP_JUMP_LT || op == OP_JUMP_GT
+           || op == OP_END || op == OP_FAIL || op == OP_CLOSED_LOOP;
+}
+
+static int successors(const Bytecode &image, int pc, int out[2]) {
+    const Instruction &ins = image.code[pc];
+    switch (baseOf(ins.op)) {
+        case OP_JUMP:
+            out[0] = ins.arg;
+            return 1;
+        case OP_JUMP_EQ:
+        case OP_JUMP_LT:
+        case OP_JUMP_GT:
+            out[0] = ins.arg;
+            out[1] = pc + 1;
+            return 2;
+        case OP_CLOSED_LOOP:
+            out[0] = image.loops[ins.arg].exit;
+            out[1] = pc + 1;
+            return 2;
+        case OP_END:
+        case OP_FAIL:
+            return 0;
+        default:
+            out[0] = pc + 1;
+            return pc + 1 < int(image.code.size()) ? 1 : 0;
+    }
+}
+
+static bool assigns(const Instruction &ins) {
+    return ins.op == OP_STORE || ins.op == OP_ASSIGN || ins.op == OP_INPUT;
+}
+
+static bool contains(const std::vector<uint64_t> &set, int slot) {
+    return (set[slot >> 6] >> (slot & 63)) & 1;
+}
+
+static void insert(std::vector<uint64_t> &set, int slot) {
+    set[slot >> 6] |= uint64_t(1) << (slot & 63);
+}
+
+/*
+ * Implementation notes: analyze
+ * -----------------------------
+ * The image is split into basic blocks, which start at the first
+ * instruction, at every jump target and after every instruction that
+ * can transfer control.  The sets on entry to the blocks start out
+ * full, except for the first, and are intersected with the sets that
+ * flow in until nothing changes; a worklist visits every block that
+ * is reachable at least once.  A second pass over the blocks then
+ * decides every read.
+ */
+
+void DefiniteAssignment::analyze(const Bytecode &source, const EvalState &state) {
+    image = &source;
+    const std::vector<Instruction> &code = source.code;
+    int size = int(code.size());
+    variables = state.size();
+    words = (variables + 63) / 64;
+    loads = unchecked = 0;
+
+    std::vector<char> leader(size + 1, 0);
+    leader[0] = 1;
+    for (int pc = 0; pc < size; pc++) {
+        int next[2];
+        if (!isBranch(baseOf(code[pc].op))) continue;
+        leader[pc + 1] = 1;
+        for (int i = successors(source, pc, next) - 1; i >= 0; i--) {
+            leader[next[i]] = 1;
+        }
+    }
+    blockStart.clear();
+    blockOf.assign(size, 0);
+    for (int pc = 0; pc < size; pc++) {
+        if (leader[pc]) blockStart.push_back(pc);
+        blockOf[pc] = int(blockStart.size()) - 1;
+    }
+    int blocks = int(blockStart.size());
+    blockStart.push_back(size);
+    safe.assign(size, 0);
+    if (size_t(blocks) * std::max(words, 1) > MAX_WORDS) {
+        entry.clear();
+        for (const Instruction &ins: code) {
+            if (baseOf(ins.op) == OP_LOAD) loads++;
+        }
+        return;
+    }
+
+    entry.assign(blocks, Set(words, ~uint64_t(0)));
+    Set &start = entry[0];
+    std::fill(start.begin(), start.end(), 0);
+    for (int slot = 0; slot < state.size(); slot++) {
+        if (state.isDefined(slot)) insert(start, slot);
+    }
+    std::vector<char> reached(blocks, 0), queued(blocks, 0);
+    std::vector<int> worklist = {0};
+    reached[0] = queued[0] = 1;
+    Set current;
+    while (!worklist.empty()) {
+        int block = worklist.back();
+        worklist.pop_back();
+        queued[block] = 0;
+        current = entry[block];
+        int last = blockStart[block + 1] - 1;
+        for (int pc = blockStart[block]; pc <= last; pc++) {
+            if (assigns(code[pc])) insert(current, code[pc].arg);
+        }
+        int next[2];
+        for (int i = successors(source, last, next) - 1; i >= 0; i--) {
+            int target = blockOf[next[i]];
+            Set &in = entry[target];
+            bool changed = !reached[target];
+            for (int w = 0; w < words; w++) {
+                uint64_t meet = in[w] & current[w];
+                changed |= meet != in[w];
+                in[w] = meet;
+            }
+            reached[target] = 1;
+            if (changed && !queued[target]) {
+                queued[target] = 1;
+                worklist.push_back(target);
+            }
+        }
+    }
+
+    for (int block = 0; block < blocks; block++) {
+        current = entry[block];
+        for (int pc = blockStart[block]; pc < blockStart[block + 1]; pc++) {
+            const Instruction &ins = code[pc];
+            if (baseOf(ins.op) == OP_LOAD) {
+                loads++;
+                if (contains(current, ins.arg)) {
+                    safe[pc] = 1;
+                    unchecked++;
+                }
+            }
+            if (assigns(ins)) insert(current, ins.arg);
+        }
+    }
+}
+
+void DefiniteAssignment::apply(Bytecode &target) const {
+    for (size_t pc = 0; pc < target.code.size() && pc < safe.size(); pc++) {
+        if (safe[pc] && target.code[pc].op == OP_LOAD) target.code[pc].op = OP_LOAD_DEFINED;
+    }
+}
+
+DefiniteAssignment::Set DefiniteAssignment::before(int pc) const {
+    int block = blockOf[pc];
+    Set current = entry[block];
+    for (int i = blockStart[block]; i < pc; i++) {
+        if (assigns(image->code[i])) insert(current, image->code[i].arg);
+    }
+    return current;
+}
+
+bool DefiniteAssignment::isDefined(int pc, int slot) const {
+    if (entry.empty() || pc < 0 || pc >= int(blockOf.size()) || slot < 0 || slot >= variables) return false;
+    return contains(before(pc), slot);
+}
+
+std::vector<int> DefiniteAssignment::definedAt(int pc) const {
+    std::vector<int> slots;
+    if (entry.empty() || pc < 0 || pc >= int(blockOf.size())) return slots;
+    Set current = before(pc);
+    for (int slot = 0; slot < variables; slot++) {
+        if (contains(current, slot)) slots.push_back(slot);
+    }
+    return slots;
+}
+
+int DefiniteAssignment::reads() const {
+    return loads;
+}
+
+int DefiniteAssignment::uncheckedReads() const {
+    return unchecked;
+}
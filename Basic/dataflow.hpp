@@ -0,0 +1,110 @@
+/*
+ * File: dataflow.hpp
+ * ------------------
+ * This interface exports the DefiniteAssignment class, a dataflow
+ * analysis that finds the variable reads of a compiled program that
+ * can never raise VARIABLE NOT DEFINED.
+ */
+
+#ifndef _dataflow_h
+#define _dataflow_h
+
+#include <cstdint>
+#include <vector>
+#include "evalstate.hpp"
+#include "vm.hpp"
+
+/*
+ * Class: DefiniteAssignment
+ * -------------------------
+ * A forward analysis over the control-flow graph of a Bytecode image,
+ * whose edges are the fall-through from one instruction to the next
+ * and the jumps of GOTO, IF and closed loops.  A variable is
+ * definitely assigned before an instruction if it was defined when
+ * the analysis ran or is assigned on every path from the start of the
+ * program to that instruction.  Since a running program never loses a
+ * variable, the result stays valid for the rest of the run, including
+ * when the program is entered at a loop head by the tiered engine.
+ */
+
+class DefiniteAssignment {
+
+public:
+
+/*
+ * Method: analyze
+ * Usage: analysis.analyze(image, state);
+ * --------------------------------------
+ * Analyzes a compiled program, taking the variables currently defined
+ * in the EvalState as defined on entry.  Programs with so many blocks
+ * and variables that the sets would not fit in MAX_WORDS words are not
+ * analyzed, which leaves every read checked.
+ */
+
+    void analyze(const Bytecode &image, const EvalState &state);
+
+/*
+ * Method: apply
+ * Usage: analysis.apply(image);
+ * -----------------------------
+ * Replaces every OP_LOAD of the analyzed image that reads a definitely
+ * assigned variable by OP_LOAD_DEFINED, which omits the check.
+ */
+
+    void apply(Bytecode &image) const;
+
+/*
+ * Method: isDefined
+ * Usage: if (analysis.isDefined(pc, slot)) ...
+ * --------------------------------------------
+ * Returns true if the variable in the specified slot is definitely
+ * assigned before instruction pc is executed.  Instructions that no
+ * path reaches count every variable as assigned.
+ */
+
+    bool isDefined(int pc, int slot) const;
+
+/*
+ * Method: definedAt
+ * Usage: std::vector<int> slots = analysis.definedAt(pc);
+ * -------------------------------------------------------
+ * Returns the slots of the variables definitely assigned before
+ * instruction pc, in ascending order.
+ */
+
+    std::vector<int> definedAt(int pc) const;
+
+/*
+ * Methods: reads, uncheckedReads
+ * Usage: int total = analysis.reads();
+ *        int safe = analysis.uncheckedReads();
+ * ----------------------------------------------
+ * Return the number of OP_LOAD instructions of the analyzed image and
+ * how many of them read a definitely assigned variable.
+ */
+
+    int reads() const;
+
+    int uncheckedReads() const;
+
+    static const size_t MAX_WORDS = size_t(1) << 22;
+
+private:
+
+    typedef std::vector<uint64_t> Set;
+
+    const Bytecode *image = nullptr;
+    int variables = 0;
+    int words = 0;
+    int loads = 0;
+    int unchecked = 0;
+    std::vector<int> blockOf;           /* Block of each instruction      */
+    std::vector<int> blockStart;        /* First instruction of each block */
+    std::vector<Set> entry;             /* Assigned on entry to each block */
+    std::vector<char> safe;             /* Whether each OP_LOAD is safe    */
+
+    Set before(int pc) const;
+
+};
+
+#endif
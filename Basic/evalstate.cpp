@@ -7,7 +7,9 @@
  */
 
 
+#include <algorithm>
 #include "evalstate.hpp"
+#include "memstats.hpp"
 
 
 //using namespace std;
@@ -22,20 +24,74 @@ EvalState::~EvalState() {
     /* Empty */
 }
 
-void EvalState::setValue(std::string var, int value) {
-    if (isDefined(var)) symbolTable[var] = value;
-    else symbolTable.emplace(var, value);
+void EvalState::setValue(const std::string &var, int value) {
+    setValue(slotOf(var), value);
 }
 
-int EvalState::getValue(std::string var) {
-    if (isDefined(var)) return symbolTable[var];
-    else return 0;
+int EvalState::getValue(const std::string &var) {
+    auto slot = slots.find(var);
+    if (slot == slots.end()) return 0;
+    return getValue(slot->second);
 }
 
-bool EvalState::isDefined(std::string var) {
-    return symbolTable.find(var) != symbolTable.end();
+bool EvalState::isDefined(const std::string &var) {
+    auto slot = slots.find(var);
+    return slot != slots.end() && isDefined(slot->second);
 }
 
+int EvalState::slotOf(const std::string &var) {
+    auto slot = slots.find(var);
+    if (slot != slots.end()) return slot->second;
+    MemoryScope scope(MEMORY_SYMBOLS);
+    names.push_back(var);
+    values.push_back(0);
+    defined.push_back(0);
+    return slots[var] = int(names.size()) - 1;
+}
+
+const std::string &EvalState::nameOf(int slot) const {
+    return names[slot];
+}
+
+int *EvalState::valueData() {
+    return values.data();
+}
+
+char *EvalState::definedData() {
+    return defined.data();
+}
+
+int EvalState::size() const {
+    return int(names.size());
+}
+
+/*
+ * Implementation notes: bytes
+ * ---------------------------
+ * The hash table is counted as its bucket array plus one node per
+ * entry holding the key, the slot and the links a node-based table
+ * keeps, which is what libstdc++ allocates.
+ */
+
+size_t EvalState::bytes() const {
+    size_t total = names.capacity() * sizeof(std::string) + values.capacity() * sizeof(int)
+                   + defined.capacity() * sizeof(char);
+    total += slots.bucket_count() * sizeof(void *);
+    total += slots.size() * (sizeof(std::pair<const std::string, int>) + 2 * sizeof(void *));
+    for (const std::string &name: names) {
+        if (name.capacity() > std::string().capacity()) total += 2 * (name.capacity() + 1);
+    }
+    return total;
+}
+
+/*
+ * Implementation notes: Clear
+ * ---------------------------
+ * Clearing undefines every variable but keeps the slot assignment,
+ * since parsed statements may still refer to the slots.
+ */
+
 void EvalState::Clear() {
-    symbolTable.clear();
-}
\ No newline at end of file
+    std::fill(values.begin(), values.end(), 0);
+    std::fill(defined.begin(), defined.end(), 0);
+}
@@ -10,7 +10,8 @@
 #define _evalstate_h
 
 #include <string>
-#include <map>
+#include <unordered_map>
+#include <vector>
 
 /*
  * Class: EvalState
@@ -20,8 +21,12 @@
  * environment that the evaluator may need to know.  In this
  * version, the only information maintained by the EvalState class
  * is a symbol table that maps variable names into their values.
- * In your implementation, you may include additional information
- * in the EvalState class.
+ *
+ * Every variable name is given an integer slot the first time it is
+ * seen.  The values live in a contiguous array indexed by slot, next
+ * to an array of flags that records which slots are defined, so the
+ * evaluator can read and write variables without touching a string.
+ * The name-based methods remain for immediate mode and for tools.
  */
 
 class EvalState {
@@ -53,7 +58,7 @@ public:
  * Sets the value associated with the specified var.
  */
 
-    void setValue(std::string var, int value);
+    void setValue(const std::string &var, int value);
 
 /*
  * Method: getValue
@@ -62,7 +67,7 @@ public:
  * Returns the value associated with the specified variable.
  */
 
-    int getValue(std::string var);
+    int getValue(const std::string &var);
 
 /*
  * Method: isDefined
@@ -71,13 +76,85 @@ public:
  * Returns true if the specified variable is defined.
  */
 
-    bool isDefined(std::string var);
+    bool isDefined(const std::string &var);
+
+/*
+ * Method: slotOf
+ * Usage: int slot = state.slotOf(var);
+ * ------------------------------------
+ * Returns the slot of the specified variable, allocating a new one
+ * (initially undefined) if the name has not been seen before.  Slots
+ * stay valid for the lifetime of the EvalState, even across Clear.
+ */
+
+    int slotOf(const std::string &var);
+
+/*
+ * Method: nameOf
+ * Usage: string var = state.nameOf(slot);
+ * ---------------------------------------
+ * Returns the name of the variable stored in the specified slot.
+ */
+
+    const std::string &nameOf(int slot) const;
+
+/*
+ * Methods: setValue, getValue, isDefined (slot versions)
+ * Usage: state.setValue(slot, value);
+ *        int value = state.getValue(slot);
+ *        if (state.isDefined(slot)) . . .
+ * ------------------------------------------------------
+ * These methods work like their name-based counterparts but take a
+ * slot obtained from slotOf.  They are used on the hot path of the
+ * evaluator and are therefore defined inline.
+ */
+
+    void setValue(int slot, int value) {
+        values[slot] = value;
+        defined[slot] = 1;
+    }
+
+    int getValue(int slot) const {
+        return values[slot];
+    }
+
+    bool isDefined(int slot) const {
+        return defined[slot] != 0;
+    }
+
+/*
+ * Methods: valueData, definedData
+ * Usage: int *values = state.valueData();
+ * ---------------------------------------
+ * Expose the slot arrays to the VM.  The pointers stay valid until
+ * the next call to slotOf that allocates a new slot.
+ */
+
+    int *valueData();
+
+    char *definedData();
+
+    int size() const;
+
+/*
+ * Method: bytes
+ * Usage: size_t used = state.bytes();
+ * -----------------------------------
+ * Returns an estimate of the memory the symbol table occupies: the
+ * slot arrays including unused capacity, the hash table and the heap
+ * storage of names that do not fit in a string's inline buffer.
+ */
+
+    size_t bytes() const;
 
     void Clear();
 
 private:
 
-    std::map<std::string, int> symbolTable;
+    std::unordered_map<std::string, int> slots;
+    std::vector<std::string> names;
+    std::vector<int> values;
+    std::vector<char> defined;
 
 };
 
@@ -1,151 +1,530 @@
 /*
  * File: exp.cpp
  * -------------
- * This file implements the Expression class and its subclasses.
+ * This file implements the ExpArena class.
  */
 
+#include <algorithm>
 #include "exp.hpp"
-
+#include "memstats.hpp"
+#include "sampler.hpp"
+#include "vm.hpp"
 
 /*
- * Implementation notes: the Expression class
- * ------------------------------------------
- * The Expression class declares no instance variables and needs no code.
+ * Implementation notes: operatorOf, operatorName
+ * ----------------------------------------------
+ * All operators are single characters, so a token is classified by
+ * its length and first character instead of by string comparisons.
  */
 
-Expression::Expression() = default;
+Operator operatorOf(std::string_view token) {
+    if (token.size() != 1) return NOT_AN_OPERATOR;
+    switch (token[0]) {
+        case '=':
+            return ASSIGN;
+        case '+':
+            return PLUS;
+        case '-':
+            return MINUS;
+        case '*':
+            return TIMES;
+        case '/':
+            return DIVIDE;
+        default:
+            return NOT_AN_OPERATOR;
+    }
+}
 
-Expression::~Expression() = default;
+std::string operatorName(Operator op) {
+    static const char *const names[] = {"=", "+", "-", "*", "/", ""};
+    return names[op];
+}
 
 /*
- * Implementation notes: the ConstantExp subclass
- * ----------------------------------------------
- * The ConstantExp subclass declares a single instance variable that
- * stores the value of the constant.  The eval method doesn't use the
- * value of state but needs it to match the general prototype for eval.
+ * Implementation notes: raise
+ * ---------------------------
+ * Errors are raised through a function the compiler knows never
+ * returns, which keeps the construction of the message out of line
+ * and lets load and apply be inlined into eval.
  */
 
-ConstantExp::ConstantExp(int value) {
-    this->value = value;
+[[noreturn]] static void raise(const char *message) {
+    throw ErrorException(message);
 }
 
-std::string ConstantExp::getName(std::string a) {
-    return a;
+/*
+ * Implementation notes: apply
+ * ---------------------------
+ * Applies an arithmetic operator to two values.  This is the only
+ * place where the evaluator divides, so it is also the only place
+ * that reports DIVIDE BY ZERO.  The other operators wrap around modulo
+ * 2^32, like those of the VM.
+ */
+
+static inline int apply(Operator op, int left, int right) {
+    switch (op) {
+        case PLUS:
+            return int(unsigned(left) + unsigned(right));
+        case MINUS:
+            return int(unsigned(left) - unsigned(right));
+        case TIMES:
+            return int(unsigned(left) * unsigned(right));
+        case DIVIDE:
+            if (right == 0) raise("DIVIDE BY ZERO");
+            return left / right;
+        default:
+            return 0;
+    }
 }
 
-int ConstantExp::eval(EvalState &state) {
-    return value;
+static inline int load(int slot, EvalState &state) {
+    if (!state.isDefined(slot)) raise("VARIABLE NOT DEFINED");
+    return state.getValue(slot);
 }
 
-std::string ConstantExp::toString() {
-    return integerToString(value);
+/* Implementation of the ExpArena class */
+
+ExpArena::ExpArena(EvalState &state) : state(state) {}
+
+int ExpArena::append(ExpressionType type, Operator op, int lhs, int rhs) {
+    if (nodes.size() == nodes.capacity()) {
+        MemoryScope scope(MEMORY_EXPRESSIONS);
+        nodes.reserve(std::max<size_t>(16, 2 * nodes.capacity()));
+    }
+    nodes.push_back({type, op, lhs, rhs});
+    return int(nodes.size()) - 1;
 }
 
-ExpressionType ConstantExp::getType() {
-    return CONSTANT;
+int ExpArena::constant(int value) {
+    return append(CONSTANT, NOT_AN_OPERATOR, value, 0);
 }
 
-int ConstantExp::getValue(int i) {
-    return value;
+int ExpArena::identifier(const std::string &name) {
+    return append(IDENTIFIER, NOT_AN_OPERATOR, state.slotOf(name), 0);
 }
 
 /*
- * Implementation notes: the IdentifierExp subclass
- * ------------------------------------------------
- * The IdentifierExp subclass declares a single instance variable that
- * stores the name of the variable.  The implementation of eval must
- * look this variable up in the evaluation state.
+ * Implementation notes: compound
+ * ------------------------------
+ * A variable combined with a constant is folded into a single node.
+ * The operand nodes were appended last, so they are dropped again
+ * instead of being left behind as garbage.  Assignments keep the
+ * general shape, since their left operand is not read.
  */
 
-IdentifierExp::IdentifierExp(std::string name) {
-    this->name = name;
+int ExpArena::compound(Operator op, int lhs, int rhs) {
+    if (op != ASSIGN && rhs == int(nodes.size()) - 1 && lhs == rhs - 1) {
+        const ExpNode left = nodes[lhs], right = nodes[rhs];
+        if (left.type == IDENTIFIER && right.type == CONSTANT) {
+            nodes.resize(lhs);
+            return append(VAR_OP_CONST, op, left.lhs, right.lhs);
+        }
+        if (left.type == CONSTANT && right.type == IDENTIFIER) {
+            nodes.resize(lhs);
+            return append(CONST_OP_VAR, op, left.lhs, right.lhs);
+        }
+    }
+    return append(COMPOUND, op, lhs, rhs);
 }
 
-int IdentifierExp::eval(EvalState &state) {
-    if (!state.isDefined(name)) error("VARIABLE NOT DEFINED");
-    return state.getValue(name);
+/*
+ * Implementation notes: eval
+ * --------------------------
+ * The eval method for the compound expression case must check for the
+ * assignment operator as a special case.  Unlike the arithmetic operators
+ * the assignment operator does not evaluate its left operand.  The
+ * specialised nodes evaluate their variable exactly as an IDENTIFIER
+ * node would, so errors are reported in the same order.
+ */
+
+int ExpArena::eval(int exp, EvalState &state) const {
+    if (sampler != nullptr) return sampled(exp, state);
+    return evaluate(exp, state);
 }
 
-std::string IdentifierExp::toString() {
-    return name;
+void ExpArena::setSampler(Sampler *sampler) {
+    this->sampler = sampler;
 }
 
-ExpressionType IdentifierExp::getType() {
-    return IDENTIFIER;
+int ExpArena::evaluate(int exp, EvalState &state) const {
+    const ExpNode &node = nodes[exp];
+    switch (node.type) {
+        case CONSTANT:
+            return node.lhs;
+        case IDENTIFIER:
+            return load(node.lhs, state);
+        case VAR_OP_CONST:
+            return apply(node.op, load(node.lhs, state), node.rhs);
+        case CONST_OP_VAR:
+            return apply(node.op, node.lhs, load(node.rhs, state));
+        case COMPOUND:
+            break;
+    }
+    if (node.op == ASSIGN) {
+        int slot = target(node);
+        int val = evaluate(node.rhs, state);
+        state.setValue(slot, val);
+        return val;
+    }
+    int left = evaluate(node.lhs, state);
+    int right = evaluate(node.rhs, state);
+    return apply(node.op, left, right);
 }
 
-std::string IdentifierExp::getName(std::string string) {
-    return name;
+/*
+ * Implementation notes: sampled
+ * -----------------------------
+ * Evaluates exactly like evaluate, but brackets every node with push
+ * and pop on the sampler.  An error leaves the shadow stack too deep,
+ * which does not matter since the walker starts the next line with an
+ * empty one.
+ */
+
+int ExpArena::sampled(int exp, EvalState &state) const {
+    const ExpNode &node = nodes[exp];
+    sampler->push(exp);
+    int value;
+    if (node.type != COMPOUND) {
+        value = evaluate(exp, state);
+    } else if (node.op == ASSIGN) {
+        int slot = target(node);
+        value = sampled(node.rhs, state);
+        state.setValue(slot, value);
+    } else {
+        int left = sampled(node.lhs, state);
+        int right = sampled(node.rhs, state);
+        value = apply(node.op, left, right);
+    }
+    sampler->pop();
+    return value;
 }
 
 /*
- * Implementation notes: the CompoundExp subclass
- * ----------------------------------------------
- * The CompoundExp subclass declares instance variables for the operator
- * and the left and right subexpressions.  The implementation of eval 
- * evaluates the subexpressions recursively and then applies the operator.
+ * Implementation notes: target
+ * ----------------------------
+ * Returns the slot an assignment node assigns to, after the checks on
+ * its left operand that must come before the right one is evaluated.
  */
 
-CompoundExp::CompoundExp(std::string op, std::shared_ptr<Expression> lhs, std::shared_ptr<Expression> rhs) {
-    this->op = op;
-    this->lhs = lhs;
-    this->rhs = rhs;
+int ExpArena::target(const ExpNode &node) const {
+    if (nodes[node.lhs].type != IDENTIFIER) {
+        error("Illegal variable in assignment");
+    }
+    if (state.nameOf(nodes[node.lhs].lhs) == "LET")
+        error("SYNTAX ERROR");
+    return nodes[node.lhs].lhs;
 }
 
-CompoundExp::~CompoundExp() {
+std::string ExpArena::toString(int exp) const {
+    const ExpNode &node = nodes[exp];
+    std::string op = ' ' + operatorName(node.op) + ' ';
+    switch (node.type) {
+        case CONSTANT:
+            return integerToString(node.lhs);
+        case IDENTIFIER:
+            return state.nameOf(node.lhs);
+        case VAR_OP_CONST:
+            return '(' + state.nameOf(node.lhs) + op + integerToString(node.rhs) + ')';
+        case CONST_OP_VAR:
+            return '(' + integerToString(node.lhs) + op + state.nameOf(node.rhs) + ')';
+        default:
+            return '(' + toString(node.lhs) + op + toString(node.rhs) + ')';
+    }
 }
 
 /*
- * Implementation notes: eval
- * --------------------------
- * The eval method for the compound expression case must check for the
- * assignment operator as a special case.  Unlike the arithmetic operators
- * the assignment operator does not evaluate its left operand.
+ * Implementation notes: compile
+ * -----------------------------
+ * The checks that eval makes on the left operand of an assignment only
+ * depend on the shape of the tree, so they are made here and turned
+ * into an OP_FAIL instruction that raises the same error at run time.
  */
 
-int CompoundExp::eval(EvalState &state) {
-    if (op == "=") {
-        if (lhs->getType() != IDENTIFIER) {
-            error("Illegal variable in assignment");
+static void emitOperator(Operator op, Compiler &compiler) {
+    switch (op) {
+        case PLUS:
+            compiler.emit(OP_ADD);
+            break;
+        case MINUS:
+            compiler.emit(OP_SUB);
+            break;
+        case TIMES:
+            compiler.emit(OP_MUL);
+            break;
+        default:
+            compiler.emit(OP_DIV);
+            break;
+    }
+}
+
+void ExpArena::compile(int exp, Compiler &compiler) const {
+    const ExpNode &node = nodes[exp];
+    switch (node.type) {
+        case CONSTANT:
+            compiler.emit(OP_CONST, node.lhs);
+            return;
+        case IDENTIFIER:
+            compiler.emit(OP_LOAD, node.lhs);
+            return;
+        case VAR_OP_CONST:
+            compiler.emit(OP_LOAD, node.lhs);
+            compiler.emit(OP_CONST, node.rhs);
+            emitOperator(node.op, compiler);
+            return;
+        case CONST_OP_VAR:
+            compiler.emit(OP_CONST, node.lhs);
+            compiler.emit(OP_LOAD, node.rhs);
+            emitOperator(node.op, compiler);
+            return;
+        case COMPOUND:
+            break;
+    }
+    if (node.op == ASSIGN) {
+        if (nodes[node.lhs].type != IDENTIFIER) {
+            compiler.emitFail("Illegal variable in assignment");
+            return;
         }
-        if (lhs->getType() == IDENTIFIER && lhs->toString() == "LET")
-            error("SYNTAX ERROR");
-        int val = rhs->eval(state);
-        state.setValue((lhs)->getName(std::string()), val);
-        return val;
+        if (state.nameOf(nodes[node.lhs].lhs) == "LET") {
+            compiler.emitFail("SYNTAX ERROR");
+            return;
+        }
+        compile(node.rhs, compiler);
+        compiler.emit(OP_ASSIGN, nodes[node.lhs].lhs);
+        return;
     }
-    int left = lhs->eval(state);
-    int right = rhs->eval(state);
-    if (op == "+") return left + right;
-    if (op == "-") return left - right;
-    if (op == "*") return left * right;
-    if (op == "/") {
-        if (right == 0) error("DIVIDE BY ZERO");
-        return left / right;
+    compile(node.lhs, compiler);
+    compile(node.rhs, compiler);
+    emitOperator(node.op, compiler);
+}
+
+/*
+ * Implementation notes: simplify
+ * ------------------------------
+ * The children are simplified first, then reduce looks at the node
+ * with its final operands.  Nodes are rewritten in place; a node that
+ * becomes unreachable simply stays in the range of its statement.
+ *
+ * Folding uses unsigned arithmetic, which wraps around in the same way
+ * as the int arithmetic of eval on our targets, and never folds a
+ * division whose result is undefined (by zero, or INT_MIN by -1), so
+ * that the error or trap still happens when the expression runs.
+ */
+
+static bool fold(Operator op, int left, int right, int &result) {
+    auto l = (unsigned) left, r = (unsigned) right;
+    switch (op) {
+        case PLUS:
+            result = int(l + r);
+            return true;
+        case MINUS:
+            result = int(l - r);
+            return true;
+        case TIMES:
+            result = int(l * r);
+            return true;
+        case DIVIDE:
+            if (right == 0 || (right == -1 && left == int(1u << 31))) return false;
+            result = left / right;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isIdentity(Operator op, int constant) {
+    return ((op == PLUS || op == MINUS) && constant == 0) ||
+           ((op == TIMES || op == DIVIDE) && constant == 1);
+}
+
+int ExpArena::simplify(int exp) {
+    ExpNode &node = nodes[exp];
+    if (node.type == COMPOUND) {
+        if (node.op != ASSIGN) node.lhs = simplify(node.lhs);
+        node.rhs = simplify(node.rhs);
+    }
+    return reduce(exp);
+}
+
+int ExpArena::reduce(int exp) {
+    ExpNode &node = nodes[exp];
+    Operator op = node.op;
+    if (node.type == CONST_OP_VAR && (op == PLUS || op == TIMES)) {
+        node = {VAR_OP_CONST, op, node.rhs, node.lhs};
+    }
+    if (node.type == VAR_OP_CONST && isIdentity(op, node.rhs)) {
+        node = {IDENTIFIER, NOT_AN_OPERATOR, node.lhs, 0};
+    }
+    if (node.type != COMPOUND || op == ASSIGN) return exp;
+
+    if ((op == PLUS || op == TIMES) && nodes[node.lhs].type == CONSTANT &&
+        nodes[node.rhs].type != CONSTANT) {
+        std::swap(node.lhs, node.rhs);
+    }
+    const ExpNode left = nodes[node.lhs], right = nodes[node.rhs];
+    int value;
+    if (left.type == CONSTANT && right.type == CONSTANT && fold(op, left.lhs, right.lhs, value)) {
+        node = {CONSTANT, NOT_AN_OPERATOR, value, 0};
+        return exp;
+    }
+    if (right.type == CONSTANT) {
+        if (isIdentity(op, right.lhs)) return node.lhs;
+        bool additive = (op == PLUS || op == MINUS) && (left.op == PLUS || left.op == MINUS);
+        bool multiplicative = op == TIMES && left.op == TIMES;
+        if (additive || multiplicative) {
+            int inner;
+            if (left.type == VAR_OP_CONST) inner = left.rhs;
+            else if (left.type == COMPOUND && nodes[left.rhs].type == CONSTANT) inner = nodes[left.rhs].lhs;
+            else return exp;
+            bool folded = multiplicative ? fold(TIMES, inner, right.lhs, value) :
+                          fold(left.op == PLUS ? PLUS : MINUS, 0, inner, inner) &&
+                          fold(op, inner, right.lhs, value);
+            if (!folded) return exp;
+            Operator combined = multiplicative ? TIMES : PLUS;
+            if (left.type == VAR_OP_CONST) {
+                node = {VAR_OP_CONST, combined, left.lhs, value};
+            } else {
+                nodes[node.rhs].lhs = value;
+                node.lhs = left.lhs;
+                node.op = combined;
+            }
+            return reduce(exp);
+        }
+        if (left.type == IDENTIFIER) {
+            node = {VAR_OP_CONST, op, left.lhs, right.lhs};
+        }
+        return exp;
+    }
+    if (left.type == CONSTANT && right.type == IDENTIFIER) {
+        node = {CONST_OP_VAR, op, left.lhs, right.lhs};
+        return exp;
+    }
+    if (op == MINUS && pure(node.lhs) && same(node.lhs, node.rhs)) {
+        if (left.type == IDENTIFIER) {
+            node = {VAR_OP_CONST, TIMES, left.lhs, 0};
+        } else {
+            nodes[node.rhs] = {CONSTANT, NOT_AN_OPERATOR, 0, 0};
+            node.op = TIMES;
+        }
     }
-    return 0;
+    return exp;
 }
 
-std::string CompoundExp::toString() {
-    return '(' + lhs->toString() + ' ' + op + ' ' + rhs->toString() + ')';
+/*
+ * Implementation notes: pure, same
+ * --------------------------------
+ * x - x may only be rewritten when evaluating x twice has no effect
+ * beyond evaluating it once, which holds unless x assigns a variable.
+ * It is rewritten to x * 0 rather than to 0, so x is still evaluated
+ * and any error it raises is still reported.
+ */
+
+bool ExpArena::pure(int exp) const {
+    const ExpNode &node = nodes[exp];
+    if (node.type != COMPOUND) return true;
+    return node.op != ASSIGN && pure(node.lhs) && pure(node.rhs);
+}
+
+bool ExpArena::same(int a, int b) const {
+    const ExpNode &x = nodes[a], &y = nodes[b];
+    if (x.type != y.type || x.op != y.op) return false;
+    if (x.type == COMPOUND) return same(x.lhs, y.lhs) && same(x.rhs, y.rhs);
+    return x.lhs == y.lhs && x.rhs == y.rhs;
+}
+
+ExpressionType ExpArena::getType(int exp) const {
+    return nodes[exp].type;
+}
+
+const ExpNode &ExpArena::operator[](int exp) const {
+    return nodes[exp];
 }
 
-ExpressionType CompoundExp::getType() {
-    return COMPOUND;
+int ExpArena::size() const {
+    return int(nodes.size());
 }
 
-std::string CompoundExp::getOp() {
-    return op;
+void ExpArena::relocate(int from, int to, int destination) {
+    int delta = destination - from;
+    for (int i = from; i < to; i++) {
+        ExpNode node = nodes[i];
+        if (node.type == COMPOUND) {
+            node.lhs += delta;
+            node.rhs += delta;
+        }
+        nodes[i + delta] = node;
+    }
 }
 
-std::shared_ptr<Expression> CompoundExp::getLHS() {
-    return lhs;
+size_t ExpArena::bytes() const {
+    return nodes.capacity() * sizeof(ExpNode);
+}
+
+int ExpArena::import(const ExpArena &other, int from, int to, const std::vector<int> &slots) {
+    return import(other.nodes.data(), from, to, slots);
+}
+
+int ExpArena::import(const ExpNode *source, int count, const std::vector<int> &slots) {
+    return import(source, 0, count, slots);
+}
+
+int ExpArena::import(const ExpNode *source, int from, int to, const std::vector<int> &slots) {
+    MemoryScope scope(MEMORY_EXPRESSIONS);
+    int begin = size();
+    int delta = begin - from;
+    for (int i = from; i < to; i++) {
+        ExpNode node = source[i];
+        switch (node.type) {
+            case IDENTIFIER:
+            case VAR_OP_CONST:
+                node.lhs = slots[node.lhs];
+                break;
+            case CONST_OP_VAR:
+                node.rhs = slots[node.rhs];
+                break;
+            case COMPOUND:
+                node.lhs += delta;
+                node.rhs += delta;
+                break;
+            default:
+                break;
+        }
+        nodes.push_back(node);
+    }
+    return begin;
+}
+
+bool ExpArena::wellFormed(const ExpNode *source, int from, int to, int names) {
+    for (int i = from; i < to; i++) {
+        const ExpNode &node = source[i];
+        if (node.op > NOT_AN_OPERATOR) return false;
+        switch (node.type) {
+            case CONSTANT:
+                break;
+            case IDENTIFIER:
+                if (node.lhs < 0 || node.lhs >= names) return false;
+                break;
+            case VAR_OP_CONST:
+                if (node.lhs < 0 || node.lhs >= names || node.op == ASSIGN || node.op == NOT_AN_OPERATOR) return false;
+                break;
+            case CONST_OP_VAR:
+                if (node.rhs < 0 || node.rhs >= names || node.op == ASSIGN || node.op == NOT_AN_OPERATOR) return false;
+                break;
+            case COMPOUND:
+                if (node.lhs < from || node.lhs >= i || node.rhs < from || node.rhs >= i) return false;
+                if (node.op == NOT_AN_OPERATOR) return false;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
 }
 
-std::shared_ptr<Expression> CompoundExp::getRHS() {
-    return rhs;
+void ExpArena::truncate(int size) {
+    nodes.resize(size);
 }
 
-std::string CompoundExp::getName(std::string a) {
-    return a;
+void ExpArena::clear() {
+    nodes.clear();
+    nodes.shrink_to_fit();
 }
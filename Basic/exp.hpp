@@ -1,271 +1,276 @@
 /*
  * File: exp.h
  * -----------
- * This interface defines a class hierarchy for expressions,
- * which allows the client to represent and manipulate simple
- * binary expression trees.
+ * This interface defines the representation of expression trees.
+ * Expressions are stored in an ExpArena: a contiguous vector of
+ * compact nodes that refer to their children by 32-bit indices.  An
+ * expression is identified by the index of its root node.
  */
 #pragma once
 #ifndef _exp_h
 #define _exp_h
 
 #include <string>
+#include <string_view>
+#include <vector>
 #include "Utils/error.hpp"
 #include "evalstate.hpp"
 #include "Utils/strlib.hpp"
 
+class Compiler;
+
+class Sampler;
+
 /*
  * Type: ExpressionType
  * --------------------
- * This enumerated type is used to differentiate the three different
- * expression types: CONSTANT, IDENTIFIER, and COMPOUND.
+ * This enumerated type is used to differentiate the node types:
+ * CONSTANT, IDENTIFIER and COMPOUND, plus the two specialised
+ * compound shapes VAR_OP_CONST (such as I + 1) and CONST_OP_VAR
+ * (such as 0 - X), whose operands are stored inside the node itself.
  */
 
-enum ExpressionType {
-    CONSTANT, IDENTIFIER, COMPOUND
+enum ExpressionType : unsigned char {
+    CONSTANT, IDENTIFIER, COMPOUND, VAR_OP_CONST, CONST_OP_VAR
 };
 
 /*
- * Class: Expression
- * -----------------
- * This class is used to represent a node in an expression tree.
- * Expression is an example of an abstract class, which defines
- * the structure and behavior of a set of classes but has no
- * objects of its own.  Any object must be one of the three
- * concrete subclasses of Expression:
- *
- *  1. ConstantExp   -- an integer constant
- *  2. IdentifierExp -- a string representing an identifier
- *  3. CompoundExp   -- two expressions combined by an operator
- *
- * The Expression class defines the interface common to all
- * Expression objects; each subclass provides its own specific
- * implementation of the common interface.
- *
- * Note on syntax: Each of the virtual methods in the Expression
- * class is marked with the designation = 0 on the prototype line.
- * This notation is used in C++ to indicate that this method is
- * purely virtual and will always be supplied by the subclass.
+ * Type: Operator
+ * --------------
+ * The binary operators a compound node can apply.  NOT_AN_OPERATOR is
+ * returned by operatorOf for tokens that are not operators.
  */
 
-class Expression {
-
-public:
+enum Operator : unsigned char {
+    ASSIGN, PLUS, MINUS, TIMES, DIVIDE, NOT_AN_OPERATOR
+};
 
 /*
- * Constructor: Expression
- * -----------------------
- * The base class constructor is empty.  Each subclass must provide
- * its own constructor.
+ * Functions: operatorOf, operatorName
+ * Usage: Operator op = operatorOf(token);
+ *        string token = operatorName(op);
+ * ----------------------------------------
+ * Convert between operator tokens and Operator values.
  */
 
-    Expression();
-
-/*
- * Destructor: ~Expression
- * Usage: delete exp;
- * ------------------
- * The destructor deallocates the storage for this expression.
- * It must be declared virtual to ensure that the correct subclass
- * destructor is called when deleting an expression.
- */
+Operator operatorOf(std::string_view token);
 
-    virtual ~Expression();
+std::string operatorName(Operator op);
 
 /*
- * Method: eval
- * Usage: int value = exp->eval(state);
- * ------------------------------------
- * Evaluates this expression and returns its value in the context of
- * the specified EvalState object.
+ * Type: ExpNode
+ * -------------
+ * A node of an expression tree.  The meaning of the two operand
+ * fields depends on the type of the node:
+ *
+ *   CONSTANT      lhs = value
+ *   IDENTIFIER    lhs = variable slot
+ *   COMPOUND      lhs, rhs = indices of the operand nodes
+ *   VAR_OP_CONST  lhs = variable slot, rhs = constant
+ *   CONST_OP_VAR  lhs = constant, rhs = variable slot
  */
 
-    virtual int eval(EvalState &state) = 0;
+struct ExpNode {
+    ExpressionType type;
+    Operator op;
+    int lhs;
+    int rhs;
+};
 
 /*
- * Method: toString
- * Usage: string str = exp->toString();
- * ------------------------------------
- * Returns a string representation of this expression.
+ * Class: ExpArena
+ * ---------------
+ * This class owns the nodes of all expressions of a program.  Nodes
+ * are only ever appended, so the nodes of one parsed statement form a
+ * contiguous range; Program reclaims the ranges of replaced lines in
+ * bulk by compacting the arena.
  */
 
-    virtual std::string toString() = 0;
+class ExpArena {
+
+public:
 
 /*
- * Method: type
- * Usage: ExpressionType type = exp->getType();
- * --------------------------------------------
- * Returns the type of the expression, which must be one of the constants
- * CONSTANT, IDENTIFIER, or COMPOUND.
+ * Constructor: ExpArena
+ * Usage: ExpArena arena(state);
+ * -----------------------------
+ * Creates an empty arena whose identifiers are bound to slots of the
+ * specified EvalState.
  */
 
-    virtual ExpressionType getType() = 0;
-
-    virtual std::string getName(std::string) = 0;
-};
+    explicit ExpArena(EvalState &state);
 
 /*
- * Class: ConstantExp
- * ------------------
- * This subclass represents a constant integer expression.
+ * Methods: constant, identifier, compound
+ * Usage: int exp = arena.compound(op, lhs, rhs);
+ * ----------------------------------------------
+ * Append a new node and return its index.  identifier resolves the
+ * name to its slot immediately, and compound chooses one of the
+ * specialised node types when the operands allow it.
  */
 
-class ConstantExp : public Expression {
+    int constant(int value);
 
-public:
+    int identifier(const std::string &name);
+
+    int compound(Operator op, int lhs, int rhs);
 
 /*
- * Constructor: ConstantExp
- * Usage: Expression *exp = new ConstantExp(value);
- * ------------------------------------------------
- * The constructor initializes a new integer constant expression
- * to the given value.
+ * Method: eval
+ * Usage: int value = arena.eval(exp, state);
+ * ------------------------------------------
+ * Evaluates the expression rooted at exp and returns its value in the
+ * context of the specified EvalState object.
  */
-    explicit ConstantExp() = default;
 
-    explicit ConstantExp(int value);
-
-    ~ConstantExp() override = default;
+    int eval(int exp, EvalState &state) const;
 
 /*
- * Prototypes for the virtual methods
+ * Method: setSampler
+ * Usage: arena.setSampler(&sampler);
  * ----------------------------------
- * These methods have the same prototypes as those in the Expression
- * base class and don't require additional documentation.
+ * Makes eval report every node it evaluates to the sampler, or stops
+ * it for nullptr.  Without a sampler, eval pays a single test per call.
  */
 
-    int eval(EvalState &state) override;
-
-    std::string toString() override;
+    void setSampler(Sampler *sampler);
 
-    ExpressionType getType() override;
+/*
+ * Method: toString
+ * Usage: string str = arena.toString(exp);
+ * ----------------------------------------
+ * Returns a string representation of the expression rooted at exp.
+ */
 
-    std::string getName(std::string) override;
+    std::string toString(int exp) const;
 
 /*
- * Method: getValue
- * Usage: int value = ((ConstantExp *) exp)->getValue();
- * -----------------------------------------------------
- * Returns the value field without calling eval and can be applied
- * only to an object known to be a ConstantExp.
+ * Method: compile
+ * Usage: arena.compile(exp, compiler);
+ * ------------------------------------
+ * Emits bytecode that leaves the value of the expression rooted at
+ * exp on top of the VM's value stack.
  */
 
-    int getValue(int i);
+    void compile(int exp, Compiler &compiler) const;
 
+/*
+ * Method: simplify
+ * Usage: exp = arena.simplify(exp);
+ * ---------------------------------
+ * Rewrites the expression rooted at exp in place and returns the
+ * index of its new root.  Constant subtrees are folded, identities
+ * such as x + 0 and x * 1 are removed and constants are moved to the
+ * right of commutative operators.  Every rewrite keeps the errors the
+ * original expression could raise, so a division by a constant zero
+ * is left alone and an operand is never dropped.
+ */
 
-    int value = 0;
-
-};
+    int simplify(int exp);
 
 /*
- * Class: IdentifierExp
- * --------------------
- * This subclass represents an expression corresponding to a variable.
+ * Method: getType
+ * Usage: ExpressionType type = arena.getType(exp);
+ * ------------------------------------------------
+ * Returns the type of the root node of an expression.
  */
 
-class IdentifierExp : public Expression {
+    ExpressionType getType(int exp) const;
 
-public:
+    const ExpNode &operator[](int exp) const;
+
+    int size() const;
 
 /*
- * Constructor: IdentifierExp
- * Usage: Expression *exp = new IdentifierExp(name);
- * -------------------------------------------------
- * The constructor initializes a new identifier expression
- * for the variable named by name.
+ * Method: bytes
+ * Usage: size_t used = arena.bytes();
+ * -----------------------------------
+ * Returns the memory reserved for nodes, including unused capacity.
  */
-    explicit IdentifierExp() = default;
 
-    explicit IdentifierExp(std::string name);
+    size_t bytes() const;
 
 /*
- * Prototypes for the virtual methods
- * ----------------------------------
- * These methods have the same prototypes as those in the Expression
- * base class and don't require additional documentation.
+ * Method: relocate
+ * Usage: arena.relocate(from, to, destination);
+ * ---------------------------------------------
+ * Moves the nodes in the range [from, to) so that they start at
+ * destination, which must not be larger than from, and adjusts the
+ * child indices inside the range accordingly.
  */
 
-    int eval(EvalState &state) override;
-
-    std::string toString() override;
-
-    ExpressionType getType() override;
+    void relocate(int from, int to, int destination);
 
 /*
- * Method: getName
- * Usage: string name = ((IdentifierExp *) exp)->getName();
+ * Method: import
+ * Usage: int begin = arena.import(other, from, to, slots);
  * --------------------------------------------------------
- * Returns the name field of the identifier node and can be applied only
- * to an object known to be an IdentifierExp.
+ * Appends copies of the nodes in the range [from, to) of another
+ * arena and returns the index of the first copy.  Child indices are
+ * shifted to the new position, and the variable slot s of the other
+ * arena's EvalState becomes slots[s].
  */
 
-    std::string getName(std::string string) override;
-
-    std::string name;
-
-};
+    int import(const ExpArena &other, int from, int to, const std::vector<int> &slots);
 
 /*
- * Class: CompoundExp
- * ------------------
- * This subclass represents a compound expression consisting of
- * two subexpressions joined by an operator.
+ * Method: import
+ * Usage: int begin = arena.import(nodes, count, slots);
+ * -----------------------------------------------------
+ * Appends copies of count nodes stored outside any arena, as in a
+ * compiled program read from disk, whose child indices count from the
+ * first of them.  Slots are mapped as above.
  */
 
-class CompoundExp : public Expression {
-
-public:
+    int import(const ExpNode *source, int count, const std::vector<int> &slots);
 
 /*
- * Constructor: CompoundExp
- * Usage: Expression *exp = new CompoundExp(op, lhs, rhs);
- * -------------------------------------------------------
- * The constructor initializes a new compound expression
- * which is composed of the operator (op) and the left and
- * right subexpression (lhs and rhs).
+ * Method: wellFormed
+ * Usage: if (ExpArena::wellFormed(nodes, from, to, names)) ...
+ * ------------------------------------------------------------
+ * Returns true if the nodes in the range [from, to) of an array stored
+ * outside any arena can be imported and evaluated safely: each has a
+ * known type and operator, refers only to variable slots below names,
+ * and if it is compound has operands inside the range that come before
+ * it, which rules out cycles.  Every expression the parser builds
+ * passes this check.
  */
-    CompoundExp() = default;
 
-    CompoundExp(std::string op, std::shared_ptr<Expression> lhs, std::shared_ptr<Expression> rhs);
+    static bool wellFormed(const ExpNode *source, int from, int to, int names);
 
 /*
- * Prototypes for the virtual methods
- * ----------------------------------
- * These methods have the same prototypes as those in the Expression
- * base class and don't require additional documentation.
+ * Method: truncate
+ * Usage: arena.truncate(size);
+ * ----------------------------
+ * Discards every node from index size on.
  */
 
-    ~CompoundExp() override;
+    void truncate(int size);
 
-    int eval(EvalState &state) override;
+    void clear();
 
-    std::string toString() override;
+private:
 
-    ExpressionType getType() override;
+    std::vector<ExpNode> nodes;
+    EvalState &state;
+    Sampler *sampler = nullptr;
 
-/*
- * Methods: getOp, getLHS, getRHS
- * Usage: string op = ((CompoundExp *) exp)->getOp();
- *        Expression *lhs = ((CompoundExp *) exp)->getLHS();
- *        Expression *rhs = ((CompoundExp *) exp)->getRHS();
- * ---------------------------------------------------------
- * These methods return the components of a compound node and can
- * be applied only to an object known to be a CompoundExp.
- */
+    int evaluate(int exp, EvalState &state) const;
 
-    std::string getOp();
+    int sampled(int exp, EvalState &state) const;
 
-    std::shared_ptr<Expression> getLHS();
+    int target(const ExpNode &node) const;
 
-    std::shared_ptr<Expression> getRHS();
+    int append(ExpressionType type, Operator op, int lhs, int rhs);
 
-    std::string getName(std::string) override;
+    int reduce(int exp);
 
-    std::string op;
-    std::shared_ptr<Expression> lhs, rhs;
+    int import(const ExpNode *source, int from, int to, const std::vector<int> &slots);
 
-};
+    bool pure(int exp) const;
+
+    bool same(int a, int b) const;
 
-std::shared_ptr<Expression> formula(std::string fml);
+};
 
 #endif
@@ -0,0 +1,338 @@
+/*
+ * File: imagecache.cpp
+ * --------------------
+ * This file implements the imagecache.h interface.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <mach-o/dyld.h>
+#endif
+#include "imagecache.hpp"
+#include "loader.hpp"
+#include "memstats.hpp"
+
+/*
+ * Constant: FORMAT_VERSION
+ * ------------------------
+ * Changes whenever the layout of an image changes.  Images of other
+ * versions are never read, since the version is part of their key.
+ */
+
+static const uint64_t FORMAT_VERSION = 2;
+
+/*
+ * Implementation notes: image layout
+ * ----------------------------------
+ * An image is written in the native byte order and consists of
+ *
+ *    ImageHeader
+ *    ImageLine[lines]        number, text length and statement of each line
+ *    int32_t[removed]        the numbers of the deleted lines
+ *    ExpNode[nodes]          the expression nodes of all statements
+ *    uint32_t[names]         the length of each variable name
+ *    char[]                  the variable names, then the line texts
+ *
+ * Statements refer to the nodes by index in the image and to variables
+ * by index in the name table, which is the whole variable table of the
+ * EvalState when the image was written, so that loading a cached file
+ * into a fresh interpreter allocates the same slots as parsing it.
+ * Every part is a multiple of four bytes long except the characters,
+ * which come last, so the mapped image can be read in place.
+ */
+
+struct ImageHeader {
+    char magic[8];
+    uint64_t key;               /* Hash of the source and the build */
+    uint64_t length;            /* Size of the source file          */
+    uint64_t checksum;          /* Hash of the whole image          */
+    int32_t errors;             /* SYNTAX ERROR lines to report     */
+    int32_t names;
+    int32_t lines;
+    int32_t removed;
+    int32_t nodes;
+    int32_t padding;
+    uint64_t characters;
+};
+
+struct ImageLine {
+    int32_t number;
+    uint32_t length;
+    StatementRecord statement;
+};
+
+static const char MAGIC[8] = {'B', 'A', 'S', 'I', 'C', 'I', 'M', 'G'};
+
+/*
+ * Function: hashBytes
+ * Usage: hash = hashBytes(hash, data, size);
+ * ------------------------------------------
+ * Continues a 64-bit FNV-1a hash over the specified bytes.  A new hash
+ * starts from FNV_OFFSET.
+ */
+
+static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*
+ * Implementation notes: buildIdentity
+ * -----------------------------------
+ * The interpreter has no version number of its own, so a build is
+ * identified by the format version, the sizes of the records that are
+ * stored verbatim and the time this file was compiled.  The compile
+ * time alone misses rebuilds that leave this file alone, so where the
+ * running executable can be found its size, modification time and
+ * inode are added: through /proc/self/exe on Linux and through
+ * _NSGetExecutablePath on macOS.
+ */
+
+static const char BUILD_STAMP[] = __DATE__ " " __TIME__;
+
+static bool executableInfo(struct stat &info) {
+#if defined(__linux__)
+    return stat("/proc/self/exe", &info) == 0;
+#elif defined(__APPLE__)
+    char path[4096];
+    uint32_t size = sizeof(path);
+    return _NSGetExecutablePath(path, &size) == 0 && stat(path, &info) == 0;
+#else
+    (void) info;
+    return false;
+#endif
+}
+
+static uint64_t buildIdentity() {
+    uint64_t hash = FNV_OFFSET;
+    uint64_t fields[] = {FORMAT_VERSION, sizeof(ImageHeader), sizeof(ImageLine), sizeof(ExpNode)};
+    hash = hashBytes(hash, fields, sizeof(fields));
+    hash = hashBytes(hash, BUILD_STAMP, sizeof(BUILD_STAMP));
+    struct stat info;
+    if (executableInfo(info)) {
+#if defined(__APPLE__)
+        const struct timespec &modified = info.st_mtimespec;
+#else
+        const struct timespec &modified = info.st_mtim;
+#endif
+        int64_t binary[] = {int64_t(info.st_size), int64_t(modified.tv_sec),
+                            int64_t(modified.tv_nsec), int64_t(info.st_ino)};
+        hash = hashBytes(hash, binary, sizeof(binary));
+    }
+    return hash;
+}
+
+/*
+ * Function: checksumOf
+ * Usage: uint64_t checksum = checksumOf(header, payload, size);
+ * -------------------------------------------------------------
+ * Returns the hash of an image whose header and following bytes are
+ * given, taken with the checksum field itself set to zero.
+ */
+
+static uint64_t checksumOf(ImageHeader header, const char *payload, size_t size) {
+    header.checksum = 0;
+    return hashBytes(hashBytes(FNV_OFFSET, &header, sizeof(header)), payload, size);
+}
+
+static std::string imagePath(const std::string &directory, uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bimg", (unsigned long long) key);
+    return directory + "/" + name;
+}
+
+/*
+ * Implementation notes: loadImage
+ * -------------------------------
+ * A cache file may be truncated or damaged.  Damage that leaves the
+ * structure intact, such as a changed line number or line text, would
+ * otherwise load a program that no longer matches its own listing, so
+ * the image is rejected unless it hashes to the stored checksum.  Nothing read from it is used as an index
+ * before it has been checked either: the parts must add up
+ * to the file size, the name and text lengths to the characters, and
+ * the node ranges of the statements must follow each other and cover
+ * the nodes exactly, each holding well-formed expressions.  Every
+ * statement is restored before the program is touched, so that an
+ * image that fails a check leaves nothing behind and the file is
+ * simply parsed instead.
+ */
+
+static bool loadImage(const std::string &path, uint64_t key, uint64_t length,
+                      Program &program, EvalState &state) {
+    std::unique_ptr<MappedFile> file;
+    try {
+        file = std::make_unique<MappedFile>(path);
+    } catch (ErrorException &) {
+        return false;
+    }
+    std::string_view image = file->text();
+    ImageHeader header;
+    if (image.size() < sizeof(header)) return false;
+    std::memcpy(&header, image.data(), sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.key != key || header.length != length) {
+        return false;
+    }
+    if (checksumOf(header, image.data() + sizeof(header), image.size() - sizeof(header)) != header.checksum) {
+        return false;
+    }
+    if (header.names < 0 || header.lines < 0 || header.removed < 0 || header.nodes < 0) return false;
+    if (header.errors < 0 || uint64_t(header.errors) > length) return false;
+    size_t linesAt = sizeof(header);
+    size_t removedAt = linesAt + size_t(header.lines) * sizeof(ImageLine);
+    size_t nodesAt = removedAt + size_t(header.removed) * sizeof(int32_t);
+    size_t namesAt = nodesAt + size_t(header.nodes) * sizeof(ExpNode);
+    size_t charactersAt = namesAt + size_t(header.names) * sizeof(uint32_t);
+    if (charactersAt > image.size() || image.size() - charactersAt != header.characters) return false;
+
+    const char *data = image.data();
+    const ExpNode *nodes = reinterpret_cast<const ExpNode *>(data + nodesAt);
+    const char *characters = data + charactersAt;
+    uint64_t remaining = header.characters;
+    std::vector<uint32_t> sizes(header.names);
+    for (int i = 0; i < header.names; i++) {
+        std::memcpy(&sizes[i], data + namesAt + i * sizeof(uint32_t), sizeof(uint32_t));
+        if (sizes[i] > remaining) return false;
+        remaining -= sizes[i];
+    }
+    std::vector<ImageLine> lines(header.lines);
+    int32_t next = 0;
+    for (int i = 0; i < header.lines; i++) {
+        ImageLine &line = lines[i];
+        std::memcpy(&line, data + linesAt + i * sizeof(ImageLine), sizeof(line));
+        if (line.length > remaining || (i > 0 && line.number <= lines[i - 1].number)) return false;
+        remaining -= line.length;
+        const StatementRecord &record = line.statement;
+        if (record.expBegin != next || !wellFormed(record, header.names, header.nodes) ||
+            !ExpArena::wellFormed(nodes, record.expBegin, record.expEnd, header.names)) {
+            return false;
+        }
+        next = record.expEnd;
+    }
+    if (next != header.nodes || remaining != 0) return false;
+
+    std::vector<int> slots;
+    for (int i = 0; i < header.names; i++) {
+        slots.push_back(state.slotOf(std::string(characters, sizes[i])));
+        characters += sizes[i];
+    }
+    int base = program.arena.size();
+    std::vector<SourceLine> loaded(header.lines);
+    try {
+        for (int i = 0; i < header.lines; i++) {
+            std::shared_ptr<Statement> statement = restoreStatement(lines[i].statement);
+            statement->relocate(base);
+            statement->rebind(slots);
+            MemoryScope scope(MEMORY_SOURCE);
+            loaded[i] = {lines[i].number, std::string(characters, lines[i].length), std::move(statement)};
+            characters += lines[i].length;
+        }
+    } catch (ErrorException &) {
+        return false;
+    }
+    for (int i = 0; i < header.errors; i++) {
+        program.output.write("SYNTAX ERROR\n");
+    }
+    program.arena.import(nodes, header.nodes, slots);
+    program.loadSourceLines(loaded);
+    for (int i = 0; i < header.removed; i++) {
+        int32_t number;
+        std::memcpy(&number, data + removedAt + i * sizeof(int32_t), sizeof(number));
+        program.removeSourceLine(number);
+    }
+    return true;
+}
+
+/*
+ * Implementation notes: saveImage
+ * -------------------------------
+ * The nodes of each loaded statement are copied into an arena of their
+ * own, which renumbers them from zero, and the statement is relocated
+ * to match.  Everything after the header is assembled in memory first,
+ * so that the checksum over the whole image can go into the header.  The image is written
+ * under a temporary name and renamed into place, so that a reader
+ * never sees a partial image.
+ */
+
+static void saveImage(const std::string &directory, const std::string &path, uint64_t key,
+                      uint64_t length, const LoadSummary &summary, Program &program, EvalState &state) {
+    EvalState scratch;
+    ExpArena nodes(scratch);
+    std::vector<int> slots(state.size());
+    for (int slot = 0; slot < state.size(); slot++) slots[slot] = slot;
+    std::vector<ImageLine> lines;
+    std::string characters;
+    for (int slot = 0; slot < state.size(); slot++) characters += state.nameOf(slot);
+    for (int number: summary.loaded) {
+        std::shared_ptr<Statement> statement = program.getParsedStatement(number);
+        std::string text = program.getSourceLine(number);
+        int begin = nodes.import(program.arena, statement->expBegin, statement->expEnd, slots);
+        std::shared_ptr<Statement> copy = restoreStatement(statement->save());
+        copy->relocate(begin - statement->expBegin);
+        lines.push_back({number, uint32_t(text.size()), copy->save()});
+        characters += text;
+    }
+
+    std::string payload(reinterpret_cast<const char *>(lines.data()), lines.size() * sizeof(ImageLine));
+    for (int number: summary.removed) {
+        int32_t value = number;
+        payload.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+    for (int i = 0; i < nodes.size(); i++) {
+        payload.append(reinterpret_cast<const char *>(&nodes[i]), sizeof(ExpNode));
+    }
+    for (int slot = 0; slot < state.size(); slot++) {
+        uint32_t size = uint32_t(state.nameOf(slot).size());
+        payload.append(reinterpret_cast<const char *>(&size), sizeof(size));
+    }
+    payload += characters;
+
+    ImageHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.key = key;
+    header.length = length;
+    header.errors = summary.errors;
+    header.names = state.size();
+    header.lines = int32_t(lines.size());
+    header.removed = int32_t(summary.removed.size());
+    header.nodes = nodes.size();
+    header.characters = characters.size();
+    header.checksum = checksumOf(header, payload.data(), payload.size());
+
+    mkdir(directory.c_str(), 0777);
+    std::string temporary = path + ".tmp" + std::to_string(getpid());
+    FILE *out = fopen(temporary.c_str(), "wb");
+    if (out == nullptr) return;
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = ok && fwrite(payload.data(), 1, payload.size(), out) == payload.size();
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0) unlink(temporary.c_str());
+}
+
+void loadProgramCached(const std::string &path, const std::string &directory,
+                       Program &program, EvalState &state) {
+    uint64_t key, length;
+    {
+        MappedFile source(path);
+        std::string_view text = source.text();
+        uint64_t build = buildIdentity();
+        key = hashBytes(hashBytes(FNV_OFFSET, &build, sizeof(build)), text.data(), text.size());
+        length = text.size();
+    }
+    std::string image = imagePath(directory, key);
+    if (loadImage(image, key, length, program, state)) return;
+    LoadSummary summary = loadProgram(path, program, state);
+    saveImage(directory, image, key, length, summary, program, state);
+}
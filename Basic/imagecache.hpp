@@ -0,0 +1,33 @@
+/*
+ * File: imagecache.hpp
+ * --------------------
+ * This interface exports loadProgramCached, which keeps the parsed
+ * form of loaded files on disk so that loading an unchanged file again
+ * skips the parser.
+ */
+
+#ifndef _imagecache_h
+#define _imagecache_h
+
+#include <string>
+#include "program.hpp"
+
+/*
+ * Function: loadProgramCached
+ * Usage: loadProgramCached(path, directory, program, state);
+ * ----------------------------------------------------------
+ * Has the same effect as loadProgram(path, program, state), including
+ * the SYNTAX ERROR reports, but looks in the specified directory for
+ * an image of the file first.  An image holds the statements, their
+ * expression nodes, the variable names and the line texts of the
+ * loaded lines, and is found by a hash of the file's contents and of
+ * the interpreter binary, so that editing the file or rebuilding the
+ * interpreter makes old images unused.  On a miss the file is loaded
+ * normally and its image written; failing to write one is not an
+ * error, and the directory is created if it does not exist.
+ */
+
+void loadProgramCached(const std::string &path, const std::string &directory,
+                       Program &program, EvalState &state);
+
+#endif
@@ -0,0 +1,321 @@
+/*
+ * File: jit.cpp
+ * -------------
+ * This file implements the Jit class.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "jit.hpp"
+#include "Utils/error.hpp"
+
+/*
+ * Constants: status codes
+ * -----------------------
+ * The values the generated function returns.  A status of
+ * STATUS_MESSAGE + k reports the message k of the OP_FAIL table.
+ */
+
+enum {
+    STATUS_END, STATUS_UNDEFINED, STATUS_DIVIDE, STATUS_MESSAGE
+};
+
+Jit::~Jit() {
+    release();
+}
+
+void Jit::release() {
+    if (buffer != nullptr) munmap(buffer, capacity);
+    buffer = nullptr;
+    capacity = 0;
+}
+
+#if BASIC_JIT
+
+/*
+ * Implementation notes: register usage
+ * ------------------------------------
+ * The generated function has the C signature
+ *
+ *    int program(int *values, char *defined, Output *output, int *stack,
+ *                const void *entry);
+ *
+ * jumps to entry and keeps its state in callee-saved registers, so that calls to the
+ * PRINT helper need no spilling:
+ *
+ *    rbx  values      r14  defined      r12  output
+ *    r15  value stack pointer           eax  top of the value stack
+ *
+ * With a stack of depth d, the elements below the top are stored at
+ * r15 - 4 * (d - 1) .. r15 - 4, and pushing spills eax to [r15].  The
+ * stack buffer starts one element early so that a push onto an empty
+ * stack has somewhere to spill the meaningless eax.
+ */
+
+namespace {
+
+class Assembler {
+
+public:
+
+    std::vector<unsigned char> code;
+
+    void bytes(std::initializer_list<unsigned char> list) {
+        code.insert(code.end(), list);
+    }
+
+    void imm32(int32_t value) {
+        unsigned char raw[4];
+        std::memcpy(raw, &value, 4);
+        code.insert(code.end(), raw, raw + 4);
+    }
+
+    void imm64(uint64_t value) {
+        unsigned char raw[8];
+        std::memcpy(raw, &value, 8);
+        code.insert(code.end(), raw, raw + 8);
+    }
+
+    int here() const {
+        return int(code.size());
+    }
+
+    /* Emits a 32-bit displacement to be patched later and returns its position. */
+    int rel32() {
+        imm32(0);
+        return here() - 4;
+    }
+
+    void patch(int position, int target) {
+        int32_t rel = target - (position + 4);
+        std::memcpy(&code[position], &rel, 4);
+    }
+
+    void push() {
+        bytes({0x41, 0x89, 0x07});          /* mov [r15], eax */
+        bytes({0x49, 0x83, 0xC7, 0x04});    /* add r15, 4 */
+    }
+
+    void pop() {
+        bytes({0x49, 0x83, 0xEF, 0x04});    /* sub r15, 4 */
+        bytes({0x41, 0x8B, 0x07});          /* mov eax, [r15] */
+    }
+
+};
+
+}
+
+static void print(Output *output, int value) {
+    output->print(value);
+}
+
+static int closeLoop(const ClosedLoop *loop, int *values, char *defined) {
+    return loop->run(values, defined);
+}
+
+/*
+ * Implementation notes: compile
+ * -----------------------------
+ * The code is assembled into a vector together with a table of native
+ * offsets for every bytecode position.  Branches to other
+ * instructions and to the shared error exits are recorded and patched
+ * once all offsets are known.  The result is then copied into a fresh
+ * mapping, which is made executable and read-only.  Division only
+ * checks for zero and then uses a plain idiv, so that INT_MIN / -1
+ * traps like the division of the other engines does.
+ */
+
+bool Jit::compile(const Bytecode &image) {
+    release();
+    for (const Instruction &ins: image.code) {
+        if (ins.op == OP_INPUT) return false;
+    }
+    loops = image.loops;
+    Assembler a;
+    offsets.assign(image.code.size(), 0);
+    std::vector<std::pair<int, int> > jumps;        /* (rel32 position, bytecode target) */
+    std::vector<int> undefined, divide;             /* rel32 positions of error exits */
+
+    a.bytes({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});   /* push rbx, r12..r15 */
+    a.bytes({0x48, 0x89, 0xFB});                    /* mov rbx, rdi */
+    a.bytes({0x49, 0x89, 0xF6});                    /* mov r14, rsi */
+    a.bytes({0x49, 0x89, 0xD4});                    /* mov r12, rdx */
+    a.bytes({0x49, 0x89, 0xCF});                    /* mov r15, rcx */
+    a.bytes({0x41, 0xFF, 0xE0});                    /* jmp r8 */
+
+    std::vector<int> exits;                         /* rel32 positions of jumps to the epilogue */
+    for (size_t pc = 0; pc < image.code.size(); pc++) {
+        const Instruction &ins = image.code[pc];
+        offsets[pc] = a.here();
+        switch (baseOf(ins.op)) {
+            case OP_CONST:
+                a.push();
+                a.bytes({0xB8});                    /* mov eax, imm32 */
+                a.imm32(ins.arg);
+                break;
+            case OP_LOAD:
+                a.bytes({0x41, 0x80, 0xBE});        /* cmp byte [r14 + slot], 0 */
+                a.imm32(ins.arg);
+                a.bytes({0x00});
+                a.bytes({0x0F, 0x84});              /* je undefined */
+                undefined.push_back(a.rel32());
+                a.push();
+                a.bytes({0x8B, 0x83});              /* mov eax, [rbx + 4 * slot] */
+                a.imm32(ins.arg * 4);
+                break;
+            case OP_LOAD_DEFINED:
+                a.push();
+                a.bytes({0x8B, 0x83});              /* mov eax, [rbx + 4 * slot] */
+                a.imm32(ins.arg * 4);
+                break;
+            case OP_STORE:
+            case OP_ASSIGN:
+                a.bytes({0x89, 0x83});              /* mov [rbx + 4 * slot], eax */
+                a.imm32(ins.arg * 4);
+                a.bytes({0x41, 0xC6, 0x86});        /* mov byte [r14 + slot], 1 */
+                a.imm32(ins.arg);
+                a.bytes({0x01});
+                if (ins.op == OP_STORE) a.pop();
+                break;
+            case OP_ADD:
+                a.bytes({0x49, 0x83, 0xEF, 0x04});  /* sub r15, 4 */
+                a.bytes({0x41, 0x03, 0x07});        /* add eax, [r15] */
+                break;
+            case OP_SUB:
+                a.bytes({0x89, 0xC1});              /* mov ecx, eax */
+                a.pop();
+                a.bytes({0x29, 0xC8});              /* sub eax, ecx */
+                break;
+            case OP_MUL:
+                a.bytes({0x49, 0x83, 0xEF, 0x04});  /* sub r15, 4 */
+                a.bytes({0x41, 0x0F, 0xAF, 0x07});  /* imul eax, [r15] */
+                break;
+            case OP_DIV:
+                a.bytes({0x89, 0xC1});              /* mov ecx, eax */
+                a.bytes({0x85, 0xC9});              /* test ecx, ecx */
+                a.bytes({0x0F, 0x84});              /* je divide */
+                divide.push_back(a.rel32());
+                a.pop();
+                a.bytes({0x99});                    /* cdq */
+                a.bytes({0xF7, 0xF9});              /* idiv ecx */
+                break;
+            case OP_PRINT:
+                a.bytes({0x89, 0xC6});              /* mov esi, eax */
+                a.bytes({0x4C, 0x89, 0xE7});        /* mov rdi, r12 */
+                a.bytes({0x48, 0xB8});              /* mov rax, print */
+                a.imm64(reinterpret_cast<uint64_t>(&print));
+                a.bytes({0xFF, 0xD0});              /* call rax */
+                a.pop();
+                break;
+            case OP_JUMP:
+                a.bytes({0xE9});                    /* jmp target */
+                jumps.emplace_back(a.rel32(), ins.arg);
+                break;
+            case OP_JUMP_EQ:
+            case OP_JUMP_LT:
+            case OP_JUMP_GT: {
+                static const unsigned char condition[] = {0x84, 0x8C, 0x8F};  /* je, jl, jg */
+                a.bytes({0x41, 0x8B, 0x4F, 0xFC});  /* mov ecx, [r15 - 4] */
+                a.bytes({0x39, 0xC1});              /* cmp ecx, eax */
+                a.bytes({0x4D, 0x8D, 0x7F, 0xF8});  /* lea r15, [r15 - 8] */
+                a.bytes({0x41, 0x8B, 0x07});        /* mov eax, [r15] */
+                a.bytes({0x0F, condition[ins.op - OP_JUMP_EQ]});
+                jumps.emplace_back(a.rel32(), ins.arg);
+                break;
+            }
+            case OP_END:
+                a.bytes({0x31, 0xC0});              /* xor eax, eax */
+                a.bytes({0xE9});                    /* jmp exit */
+                exits.push_back(a.rel32());
+                break;
+            case OP_CLOSED_LOOP:
+                a.bytes({0x48, 0xBF});              /* mov rdi, loop */
+                a.imm64(reinterpret_cast<uint64_t>(&loops[ins.arg]));
+                a.bytes({0x48, 0x89, 0xDE});        /* mov rsi, rbx */
+                a.bytes({0x4C, 0x89, 0xF2});        /* mov rdx, r14 */
+                a.bytes({0x48, 0xB8});              /* mov rax, closeLoop */
+                a.imm64(reinterpret_cast<uint64_t>(&closeLoop));
+                a.bytes({0xFF, 0xD0});              /* call rax */
+                a.bytes({0x85, 0xC0});              /* test eax, eax */
+                a.bytes({0x0F, 0x85});              /* jnz exit */
+                jumps.emplace_back(a.rel32(), loops[ins.arg].exit);
+                break;
+            case OP_FAIL:
+                a.bytes({0xB8});                    /* mov eax, status */
+                a.imm32(STATUS_MESSAGE + ins.arg);
+                a.bytes({0xE9});                    /* jmp exit */
+                exits.push_back(a.rel32());
+                break;
+            default:
+                return false;
+        }
+    }
+
+    int undefinedExit = a.here();
+    a.bytes({0xB8});
+    a.imm32(STATUS_UNDEFINED);
+    a.bytes({0xE9});
+    exits.push_back(a.rel32());
+    int divideExit = a.here();
+    a.bytes({0xB8});
+    a.imm32(STATUS_DIVIDE);
+    int exit = a.here();
+    a.bytes({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B});   /* pop r15..r12, rbx */
+    a.bytes({0xC3});                                /* ret */
+
+    for (const auto &jump: jumps) a.patch(jump.first, offsets[jump.second]);
+    for (int position: undefined) a.patch(position, undefinedExit);
+    for (int position: divide) a.patch(position, divideExit);
+    for (int position: exits) a.patch(position, exit);
+
+    size_t page = size_t(sysconf(_SC_PAGESIZE));
+    capacity = (a.code.size() + page - 1) / page * page;
+    void *memory = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        capacity = 0;
+        return false;
+    }
+    std::memcpy(memory, a.code.data(), a.code.size());
+    if (mprotect(memory, capacity, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, capacity);
+        capacity = 0;
+        return false;
+    }
+    buffer = memory;
+    stack.assign(image.maxDepth + 2, 0);
+    messages = image.messages;
+    return true;
+}
+
+void Jit::run(EvalState &state, Output &output, int start) {
+    typedef int (*Program)(int *values, char *defined, Output *output, int *stack, const void *entry);
+    Program program = reinterpret_cast<Program>(buffer);
+    const void *entry = static_cast<char *>(buffer) + offsets[start];
+    int status = program(state.valueData(), state.definedData(), &output, stack.data(), entry);
+    switch (status) {
+        case STATUS_END:
+            return;
+        case STATUS_UNDEFINED:
+            error("VARIABLE NOT DEFINED");
+        case STATUS_DIVIDE:
+            error("DIVIDE BY ZERO");
+        default:
+            error(messages[status - STATUS_MESSAGE]);
+    }
+}
+
+#else
+
+bool Jit::compile(const Bytecode &image) {
+    release();
+    return false;
+}
+
+void Jit::run(EvalState &state, Output &output, int start) {
+}
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * File: jit.hpp
+ * -------------
+ * This interface exports the Jit class, which translates a Bytecode
+ * image into x86-64 machine code and runs it.
+ */
+
+#ifndef _jit_h
+#define _jit_h
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "evalstate.hpp"
+#include "output.hpp"
+#include "vm.hpp"
+
+/*
+ * Macro: BASIC_JIT
+ * ----------------
+ * Is 1 on the platforms the code generator supports: x86-64 with the
+ * System V calling convention.  Elsewhere Jit::compile always fails
+ * and programs run on the VM.
+ */
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define BASIC_JIT 1
+#else
+#define BASIC_JIT 0
+#endif
+
+/*
+ * Class: Jit
+ * ----------
+ * A template compiler from bytecode to native code.  Every instruction
+ * is translated into a fixed sequence of machine instructions: the
+ * variables stay in the slot arrays of the EvalState, the top of the
+ * value stack is kept in a register, and jumps become native branches.
+ * The generated code never throws; it returns a status that run turns
+ * into the same error the VM would raise.
+ */
+
+class Jit {
+
+public:
+
+    Jit() = default;
+
+    Jit(const Jit &) = delete;
+
+    Jit &operator=(const Jit &) = delete;
+
+/*
+ * Destructor: ~Jit
+ * ----------------
+ * Releases the executable buffer.
+ */
+
+    ~Jit();
+
+/*
+ * Method: compile
+ * Usage: if (jit.compile(image)) ...
+ * ----------------------------------
+ * Translates a bytecode image into native code.  Returns false, and
+ * leaves nothing to run, if the image uses an instruction the code
+ * generator does not handle (INPUT) or the platform is unsupported.
+ */
+
+    bool compile(const Bytecode &image);
+
+/*
+ * Method: run
+ * Usage: jit.run(state, output);
+ *        jit.run(state, output, start);
+ * -------------------------------------
+ * Runs the code produced by the last successful compile on the slot
+ * arrays of the EvalState, which must not have gained slots since.
+ * Execution begins at the code for bytecode instruction start, which
+ * must be the first instruction of a line.
+ */
+
+    void run(EvalState &state, Output &output, int start = 0);
+
+private:
+
+    void *buffer = nullptr;
+    size_t capacity = 0;
+    std::vector<int> stack;
+    std::vector<std::string> messages;
+    std::vector<int> offsets;               /* Native offset of each instruction */
+    std::vector<ClosedLoop> loops;          /* Referred to by the generated code */
+
+    void release();
+
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * File: linestore.cpp
+ * -------------------
+ * This file implements the LineStore class.
+ */
+
+#include <algorithm>
+#include <iterator>
+#include "linestore.hpp"
+
+static bool before(const SourceLine &line, int number) {
+    return line.number < number;
+}
+
+static bool after(int number, const SourceLine &line) {
+    return number < line.number;
+}
+
+SourceLine *LineStore::find(int number) {
+    int block = blockOf(number);
+    if (block == int(blocks.size())) return nullptr;
+    std::vector<SourceLine> &lines = blocks[block];
+    auto position = std::lower_bound(lines.begin(), lines.end(), number, before);
+    return position->number == number ? &*position : nullptr;
+}
+
+SourceLine *LineStore::next(int number) {
+    int block = int(std::upper_bound(last.begin(), last.end(), number) - last.begin());
+    if (block == int(blocks.size())) return nullptr;
+    std::vector<SourceLine> &lines = blocks[block];
+    return &*std::upper_bound(lines.begin(), lines.end(), number, after);
+}
+
+/*
+ * Implementation notes: insert
+ * ----------------------------
+ * A line beyond the current last one goes to the end of the last
+ * block, and a full last block is then continued in a new one, so that
+ * ascending input fills every block completely.  Any other insertion
+ * that overflows a block splits it in half.
+ */
+
+std::shared_ptr<Statement> LineStore::insert(SourceLine line) {
+    int number = line.number;
+    if (blocks.empty() || number > last.back()) {
+        if (blocks.empty() || int(blocks.back().size()) == BLOCK_SIZE) {
+            blocks.emplace_back();
+            blocks.back().reserve(BLOCK_SIZE);
+            last.push_back(number);
+        }
+        blocks.back().push_back(std::move(line));
+        last.back() = number;
+        count++;
+        return nullptr;
+    }
+    int block = blockOf(number);
+    std::vector<SourceLine> &lines = blocks[block];
+    auto position = std::lower_bound(lines.begin(), lines.end(), number, before);
+    if (position->number == number) {
+        position->text = std::move(line.text);
+        std::swap(position->statement, line.statement);
+        return std::move(line.statement);
+    }
+    lines.insert(position, std::move(line));
+    count++;
+    if (int(lines.size()) > BLOCK_SIZE) split(block);
+    return nullptr;
+}
+
+std::shared_ptr<Statement> LineStore::erase(int number) {
+    int block = blockOf(number);
+    if (block == int(blocks.size())) return nullptr;
+    std::vector<SourceLine> &lines = blocks[block];
+    auto position = std::lower_bound(lines.begin(), lines.end(), number, before);
+    if (position->number != number) return nullptr;
+    std::shared_ptr<Statement> statement = std::move(position->statement);
+    lines.erase(position);
+    count--;
+    if (lines.empty()) {
+        blocks.erase(blocks.begin() + block);
+        last.erase(last.begin() + block);
+    } else {
+        last[block] = lines.back().number;
+    }
+    return statement;
+}
+
+LineStore::iterator LineStore::begin() {
+    return iterator(&blocks, 0, 0);
+}
+
+LineStore::iterator LineStore::end() {
+    return iterator(&blocks, int(blocks.size()), 0);
+}
+
+int LineStore::size() const {
+    return count;
+}
+
+bool LineStore::empty() const {
+    return count == 0;
+}
+
+void LineStore::clear() {
+    blocks.clear();
+    last.clear();
+    count = 0;
+}
+
+size_t LineStore::bytes() const {
+    size_t total = blocks.capacity() * sizeof(std::vector<SourceLine>) + last.capacity() * sizeof(int);
+    for (const std::vector<SourceLine> &lines: blocks) {
+        total += lines.capacity() * sizeof(SourceLine);
+        for (const SourceLine &line: lines) {
+            if (line.text.capacity() > std::string().capacity()) {
+                total += line.text.capacity() + 1;
+            }
+        }
+    }
+    return total;
+}
+
+/*
+ * Implementation notes: blockOf
+ * -----------------------------
+ * Returns the first block whose largest number is not smaller than
+ * the specified one, which is the only block that can hold it, or the
+ * number of blocks if the number is beyond every line.
+ */
+
+int LineStore::blockOf(int number) const {
+    return int(std::lower_bound(last.begin(), last.end(), number) - last.begin());
+}
+
+void LineStore::split(int block) {
+    std::vector<SourceLine> &lines = blocks[block];
+    int half = int(lines.size()) / 2;
+    std::vector<SourceLine> upper;
+    upper.reserve(BLOCK_SIZE);
+    std::move(lines.begin() + half, lines.end(), std::back_inserter(upper));
+    lines.erase(lines.begin() + half, lines.end());
+    last[block] = lines.back().number;
+    blocks.insert(blocks.begin() + block + 1, std::move(upper));
+    last.insert(last.begin() + block + 1, blocks[block + 1].back().number);
+}
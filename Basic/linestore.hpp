@@ -0,0 +1,171 @@
+/*
+ * File: linestore.hpp
+ * -------------------
+ * This interface exports the LineStore class, the ordered container
+ * in which a Program keeps its lines.
+ */
+
+#ifndef _linestore_h
+#define _linestore_h
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Statement;
+
+/*
+ * Type: SourceLine
+ * ----------------
+ * A numbered line together with the statement parsed from it.  This is
+ * the unit the LineStore keeps, so that the text, the number and the
+ * statement of a line are stored side by side.
+ */
+
+struct SourceLine {
+    int number;
+    std::string text;
+    std::shared_ptr<Statement> statement;
+};
+
+/*
+ * Class: LineStore
+ * ----------------
+ * A set of SourceLines ordered by line number.  The lines are kept in
+ * a sequence of sorted blocks of at most BLOCK_SIZE lines each, next to
+ * an index holding the largest number of every block.  Lookups are
+ * two binary searches, walking the lines in order touches contiguous
+ * memory, an insertion moves at most one block, and lines that arrive
+ * in ascending order are simply appended to the last block.
+ */
+
+class LineStore {
+
+public:
+
+    static const int BLOCK_SIZE = 256;
+
+/*
+ * Class: LineStore::iterator
+ * --------------------------
+ * A forward iterator over the lines in ascending order.
+ */
+
+    class iterator {
+
+    public:
+
+        SourceLine &operator*() const {
+            return (*blocks)[block][index];
+        }
+
+        SourceLine *operator->() const {
+            return &(*blocks)[block][index];
+        }
+
+        iterator &operator++() {
+            if (++index == int((*blocks)[block].size())) {
+                block++;
+                index = 0;
+            }
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const {
+            return block == other.block && index == other.index;
+        }
+
+        bool operator!=(const iterator &other) const {
+            return !(*this == other);
+        }
+
+    private:
+
+        friend class LineStore;
+
+        iterator(std::vector<std::vector<SourceLine>> *blocks, int block, int index)
+                : blocks(blocks), block(block), index(index) {}
+
+        std::vector<std::vector<SourceLine>> *blocks;
+        int block;
+        int index;
+
+    };
+
+/*
+ * Method: find
+ * Usage: SourceLine *line = store.find(number);
+ * ---------------------------------------------
+ * Returns the line with the specified number, or nullptr if there is
+ * none.  The pointer stays valid until the store is next changed.
+ */
+
+    SourceLine *find(int number);
+
+/*
+ * Method: next
+ * Usage: SourceLine *line = store.next(number);
+ * ---------------------------------------------
+ * Returns the first line whose number is larger than the specified
+ * one, or nullptr if there is none.
+ */
+
+    SourceLine *next(int number);
+
+/*
+ * Method: insert
+ * Usage: std::shared_ptr<Statement> old = store.insert(line);
+ * ------------------------------------------------------------
+ * Adds a line to the store.  If a line with the same number exists,
+ * its text and statement are replaced and the old statement is
+ * returned; otherwise the result is nullptr.
+ */
+
+    std::shared_ptr<Statement> insert(SourceLine line);
+
+/*
+ * Method: erase
+ * Usage: std::shared_ptr<Statement> old = store.erase(number);
+ * ------------------------------------------------------------
+ * Removes the line with the specified number and returns its
+ * statement, or nullptr if there was no such line.
+ */
+
+    std::shared_ptr<Statement> erase(int number);
+
+    iterator begin();
+
+    iterator end();
+
+    int size() const;
+
+    bool empty() const;
+
+    void clear();
+
+/*
+ * Method: bytes
+ * Usage: size_t used = store.bytes();
+ * -----------------------------------
+ * Returns the memory the store itself occupies: the block and index
+ * storage including unused capacity, and the heap storage of line
+ * texts that do not fit in a string's inline buffer.  Statements and
+ * their expressions are not included.
+ */
+
+    size_t bytes() const;
+
+private:
+
+    std::vector<std::vector<SourceLine>> blocks;
+    std::vector<int> last;
+    int count = 0;
+
+    int blockOf(int number) const;
+
+    void split(int block);
+
+};
+
+#endif
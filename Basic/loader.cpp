@@ -0,0 +1,194 @@
+/*
+ * File: loader.cpp
+ * ----------------
+ * This file implements the loader.h interface.
+ */
+
+#include <algorithm>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "loader.hpp"
+#include "memstats.hpp"
+
+/*
+ * Constant: LINES_PER_WORKER
+ * --------------------------
+ * Files with fewer lines per available thread than this are parsed by
+ * fewer workers, since starting a thread costs more than parsing a
+ * few hundred lines.
+ */
+
+static const int LINES_PER_WORKER = 4096;
+
+/*
+ * Type: ParsedSource
+ * ------------------
+ * The outcome of parsing one line of the file.  error is set if the
+ * line is malformed; otherwise statement is null for a line number on
+ * its own.
+ */
+
+struct ParsedSource {
+    int number = -1;
+    bool error = false;
+    std::shared_ptr<Statement> statement;
+};
+
+/*
+ * Type: Worker
+ * ------------
+ * A worker parses a contiguous block of lines into an arena and an
+ * EvalState of its own, so that the workers share nothing.
+ */
+
+struct Worker {
+    EvalState state;
+    ExpArena arena{state};
+    std::vector<int> slots;
+};
+
+MappedFile::MappedFile(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) error("Cannot open " + path);
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        close(fd);
+        error("Cannot read " + path);
+    }
+    size = info.st_size;
+    if (size > 0) {
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) error("Cannot read " + path);
+    if (data != nullptr) madvise(data, size, MADV_SEQUENTIAL);
+}
+
+MappedFile::~MappedFile() {
+    if (data != nullptr) munmap(data, size);
+}
+
+std::string_view MappedFile::text() const {
+    return {static_cast<const char *>(data), size};
+}
+
+static std::vector<std::string_view> splitLines(std::string_view text) {
+    std::vector<std::string_view> lines;
+    lines.reserve(std::count(text.begin(), text.end(), '\n') + 1);
+    while (!text.empty()) {
+        size_t end = text.find('\n');
+        if (end == std::string_view::npos) end = text.size();
+        lines.push_back(text.substr(0, end));
+        text.remove_prefix(std::min(end + 1, text.size()));
+    }
+    return lines;
+}
+
+static void parseBlock(const std::vector<std::string_view> &lines, int from, int to,
+                       Worker &worker, std::vector<ParsedSource> &parsed) {
+    for (int i = from; i < to; i++) {
+        if (lines[i].empty()) continue;
+        ParsedSource &result = parsed[i];
+        int begin = worker.arena.size();
+        try {
+            ParsedLine line = parseLine(lines[i], worker.arena, worker.state);
+            if (line.lineNumber < 0) error("SYNTAX ERROR");
+            result.number = line.lineNumber;
+            result.statement = std::move(line.statement);
+        } catch (ErrorException &) {
+            worker.arena.truncate(begin);
+            result.error = true;
+            continue;
+        }
+        if (result.statement) {
+            result.statement->expBegin = begin;
+            result.statement->expEnd = worker.arena.size();
+        }
+    }
+}
+
+/*
+ * Implementation notes: loadProgram
+ * ---------------------------------
+ * The work is done in three passes.  First the lines are split into
+ * blocks and parsed in parallel.  Then a sequential pass over the
+ * results, in file order, reports the malformed lines and finds the
+ * line that wins for every number, which is the last well-formed one.
+ * Finally the winners are sorted and their expression nodes copied
+ * into the program's arena, with each worker's variable slots mapped
+ * to slots of the program's EvalState, before they are added to the
+ * program in one go.
+ */
+
+LoadSummary loadProgram(const std::string &path, Program &program, EvalState &state, int threads) {
+    MappedFile file(path);
+    std::vector<std::string_view> lines = splitLines(file.text());
+    int count = int(lines.size());
+
+    if (threads <= 0) threads = int(std::max(1u, std::thread::hardware_concurrency()));
+    threads = std::max(1, std::min(threads, count / LINES_PER_WORKER));
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<int> blockStart;
+    std::vector<ParsedSource> parsed(count);
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(std::make_unique<Worker>());
+        blockStart.push_back(int((long long) count * t / threads));
+    }
+    blockStart.push_back(count);
+    for (int t = 1; t < threads; t++) {
+        pool.emplace_back(parseBlock, std::cref(lines), blockStart[t], blockStart[t + 1],
+                          std::ref(*workers[t]), std::ref(parsed));
+    }
+    parseBlock(lines, blockStart[0], blockStart[1], *workers[0], parsed);
+    for (std::thread &thread: pool) thread.join();
+
+    LoadSummary summary;
+    std::vector<int> winners;
+    for (int i = 0; i < count; i++) {
+        if (parsed[i].error) {
+            program.output.write("SYNTAX ERROR\n");
+            summary.errors++;
+        } else if (parsed[i].number >= 0) {
+            winners.push_back(i);
+        }
+    }
+    std::stable_sort(winners.begin(), winners.end(), [&](int a, int b) {
+        return parsed[a].number < parsed[b].number;
+    });
+
+    for (std::unique_ptr<Worker> &worker: workers) {
+        for (int slot = 0; slot < worker->state.size(); slot++) {
+            worker->slots.push_back(state.slotOf(worker->state.nameOf(slot)));
+        }
+    }
+    std::vector<SourceLine> loaded;
+    for (size_t w = 0; w < winners.size(); w++) {
+        int i = winners[w];
+        if (w + 1 < winners.size() && parsed[winners[w + 1]].number == parsed[i].number) continue;
+        std::shared_ptr<Statement> &statement = parsed[i].statement;
+        if (!statement) {
+            summary.removed.push_back(parsed[i].number);
+            continue;
+        }
+        int t = int(std::upper_bound(blockStart.begin(), blockStart.end(), i) - blockStart.begin()) - 1;
+        Worker &worker = *workers[t];
+        int begin = program.arena.import(worker.arena, statement->expBegin, statement->expEnd, worker.slots);
+        statement->relocate(begin - statement->expBegin);
+        statement->rebind(worker.slots);
+        summary.loaded.push_back(parsed[i].number);
+        MemoryScope scope(MEMORY_SOURCE);
+        loaded.push_back({parsed[i].number, std::string(lines[i]), std::move(statement)});
+    }
+    program.loadSourceLines(loaded);
+    for (int number: summary.removed) {
+        program.removeSourceLine(number);
+    }
+    return summary;
+}
@@ -0,0 +1,80 @@
+/*
+ * File: loader.hpp
+ * ----------------
+ * This interface exports loadProgram, which reads a whole BASIC
+ * program from a file at once instead of line by line from the
+ * console.
+ */
+
+#ifndef _loader_h
+#define _loader_h
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "program.hpp"
+
+/*
+ * Class: MappedFile
+ * -----------------
+ * A read-only memory mapping of a whole file that is released when
+ * the object goes out of scope.  The constructor raises an error if
+ * the file cannot be read.
+ */
+
+class MappedFile {
+
+public:
+
+    explicit MappedFile(const std::string &path);
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile();
+
+    std::string_view text() const;
+
+private:
+
+    void *data = nullptr;
+    size_t size = 0;
+
+};
+
+/*
+ * Type: LoadSummary
+ * -----------------
+ * What loading a file did to the program: the number of malformed
+ * lines reported, the numbers of the lines added or replaced, in
+ * ascending order, and the numbers of the lines deleted afterwards.
+ */
+
+struct LoadSummary {
+    int errors = 0;
+    std::vector<int> loaded;
+    std::vector<int> removed;
+};
+
+/*
+ * Function: loadProgram
+ * Usage: loadProgram(path, program, state);
+ *        LoadSummary summary = loadProgram(path, program, state, threads);
+ * ------------------------------------------------------------------------
+ * Adds the lines of the specified file to the program.  The result is
+ * the same as typing the lines one after another: a later line
+ * replaces an earlier one with the same number, a line number on its
+ * own deletes the line, and a malformed line is reported as SYNTAX
+ * ERROR on the program's output and otherwise ignored.  Blank lines
+ * are skipped, and a line that is not numbered is malformed.
+ *
+ * The file is memory-mapped and its lines are parsed by up to threads
+ * worker threads; 0 selects one per hardware thread.  If the file
+ * cannot be read, loadProgram raises an error.
+ */
+
+LoadSummary loadProgram(const std::string &path, Program &program, EvalState &state, int threads = 0);
+
+#endif
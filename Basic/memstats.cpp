@@ -0,0 +1,149 @@
+/*
+ * File: memstats.cpp
+ * ------------------
+ * This file implements the memstats.h interface.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#elif defined(__FreeBSD__)
+#include <malloc_np.h>
+#elif defined(__linux__)
+#include <malloc.h>
+#endif
+#include "memstats.hpp"
+
+/*
+ * Implementation notes: counters
+ * ------------------------------
+ * The counters are relaxed atomics, since the loader allocates from
+ * several threads.  They are only touched once accounting has been
+ * switched on, so that an ordinary run pays one load and a branch per
+ * allocation.  A block's size at the time it is freed is asked of the
+ * allocator, so nothing has to be stored next to the block; where the
+ * allocator cannot tell, the live and peak sizes stay at zero.  The
+ * counters are plain globals with constant initialisers, which makes
+ * them usable by allocations made before main.
+ */
+
+static std::atomic<bool> accounting{false};
+static std::atomic<long long> categoryAllocations[MEMORY_CATEGORIES];
+static std::atomic<long long> categoryBytes[MEMORY_CATEGORIES];
+static std::atomic<long long> frees{0};
+static std::atomic<long long> live{0};
+static std::atomic<long long> peak{0};
+static thread_local MemoryCategory current = MEMORY_OTHER;
+
+static long long blockSize(void *memory) {
+#if defined(__APPLE__)
+    return (long long) malloc_size(memory);
+#elif defined(__linux__) || defined(__FreeBSD__)
+    return (long long) malloc_usable_size(memory);
+#else
+    (void) memory;
+    return 0;
+#endif
+}
+
+static void *allocate(size_t size, bool nothrow) {
+    void *memory = std::malloc(size == 0 ? 1 : size);
+    if (memory == nullptr) {
+        if (nothrow) return nullptr;
+        throw std::bad_alloc();
+    }
+    if (!accounting.load(std::memory_order_relaxed)) return memory;
+    categoryAllocations[current].fetch_add(1, std::memory_order_relaxed);
+    categoryBytes[current].fetch_add((long long) size, std::memory_order_relaxed);
+    long long usable = blockSize(memory);
+    long long now = live.fetch_add(usable, std::memory_order_relaxed) + usable;
+    long long highest = peak.load(std::memory_order_relaxed);
+    while (now > highest && !peak.compare_exchange_weak(highest, now, std::memory_order_relaxed)) {}
+    return memory;
+}
+
+static void release(void *memory) {
+    if (memory == nullptr) return;
+    if (accounting.load(std::memory_order_relaxed)) {
+        frees.fetch_add(1, std::memory_order_relaxed);
+        live.fetch_sub(blockSize(memory), std::memory_order_relaxed);
+    }
+    std::free(memory);
+}
+
+void *operator new(size_t size) {
+    return allocate(size, false);
+}
+
+void *operator new[](size_t size) {
+    return allocate(size, false);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size, true);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size, true);
+}
+
+void operator delete(void *memory) noexcept {
+    release(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    release(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    release(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept {
+    release(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept {
+    release(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept {
+    release(memory);
+}
+
+void enableMemoryAccounting() {
+    accounting.store(true, std::memory_order_relaxed);
+}
+
+bool memoryAccounting() {
+    return accounting.load(std::memory_order_relaxed);
+}
+
+MemoryScope::MemoryScope(MemoryCategory category) : saved(current) {
+    current = category;
+}
+
+MemoryScope::~MemoryScope() {
+    current = saved;
+}
+
+MemoryCounters memoryCounters(MemoryCategory category) {
+    return {categoryAllocations[category].load(std::memory_order_relaxed),
+            categoryBytes[category].load(std::memory_order_relaxed)};
+}
+
+HeapStats heapStats() {
+    long long allocations = 0;
+    for (int category = 0; category < MEMORY_CATEGORIES; category++) {
+        allocations += categoryAllocations[category].load(std::memory_order_relaxed);
+    }
+    return {allocations, frees.load(std::memory_order_relaxed),
+            live.load(std::memory_order_relaxed), peak.load(std::memory_order_relaxed)};
+}
+
+const char *categoryName(MemoryCategory category) {
+    static const char *names[] = {"other", "source text", "statements", "expressions", "symbol table", "scanner"};
+    return names[category];
+}
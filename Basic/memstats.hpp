@@ -0,0 +1,112 @@
+/*
+ * File: memstats.hpp
+ * ------------------
+ * This interface exports the heap accounting of the interpreter.  The
+ * global allocation functions are replaced by versions that, once
+ * accounting has been enabled, count every allocation, keep track of
+ * the live and peak heap size, and charge each allocation to the
+ * category that is current in the allocating thread.
+ */
+
+#ifndef _memstats_h
+#define _memstats_h
+
+/*
+ * Type: MemoryCategory
+ * --------------------
+ * What an allocation was made for.  MEMORY_SCANNER covers whatever
+ * parsing a line allocates that does not end up in a statement, an
+ * expression or the symbol table, and MEMORY_OTHER everything made
+ * outside any MemoryScope.
+ */
+
+enum MemoryCategory {
+    MEMORY_OTHER, MEMORY_SOURCE, MEMORY_STATEMENTS, MEMORY_EXPRESSIONS, MEMORY_SYMBOLS, MEMORY_SCANNER,
+    MEMORY_CATEGORIES
+};
+
+/*
+ * Type: MemoryCounters
+ * --------------------
+ * The number of allocations charged to a category and the bytes they
+ * requested, since accounting was enabled.
+ */
+
+struct MemoryCounters {
+    long long allocations;
+    long long bytes;
+};
+
+/*
+ * Type: HeapStats
+ * ---------------
+ * Totals over all categories.  live and peak are measured in the
+ * usable sizes of the blocks malloc handed out, which include its
+ * rounding.  Blocks allocated before accounting was enabled are not
+ * counted, but freeing one is, so the totals are only exact if
+ * accounting starts before anything they cover is allocated.  On
+ * platforms whose malloc cannot report the size of a block live and
+ * peak stay at zero.
+ */
+
+struct HeapStats {
+    long long allocations;
+    long long frees;
+    long long live;
+    long long peak;
+};
+
+/*
+ * Class: MemoryScope
+ * ------------------
+ * Charges the allocations the current thread makes while the scope
+ * exists to a category.  Scopes nest; leaving one restores the
+ * category of the enclosing scope.
+ */
+
+class MemoryScope {
+
+public:
+
+    explicit MemoryScope(MemoryCategory category);
+
+    ~MemoryScope();
+
+    MemoryScope(const MemoryScope &) = delete;
+
+    MemoryScope &operator=(const MemoryScope &) = delete;
+
+private:
+
+    MemoryCategory saved;
+
+};
+
+/*
+ * Function: enableMemoryAccounting
+ * Usage: enableMemoryAccounting();
+ * --------------------------------
+ * Starts counting allocations.  Accounting is off by default, so that
+ * runs that do not report on the heap do not pay for it, and stays on
+ * once enabled.  Call it before anything whose memory is to be
+ * measured is allocated, ideally first thing in main.
+ */
+
+void enableMemoryAccounting();
+
+/*
+ * Function: memoryAccounting
+ * Usage: if (memoryAccounting()) ...
+ * ----------------------------------
+ * Returns true if allocations are being counted.
+ */
+
+bool memoryAccounting();
+
+MemoryCounters memoryCounters(MemoryCategory category);
+
+HeapStats heapStats();
+
+const char *categoryName(MemoryCategory category);
+
+#endif
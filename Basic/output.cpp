@@ -0,0 +1,74 @@
+/*
+ * File: output.cpp
+ * ----------------
+ * This file implements the Output class.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include "output.hpp"
+
+Output::Output() {
+    policy = isatty(STDOUT_FILENO) ? LINE_BUFFERED : BLOCK_BUFFERED;
+}
+
+Output::~Output() {
+    flush();
+}
+
+/*
+ * Implementation notes: print
+ * ---------------------------
+ * The digits are produced from the right into a small local buffer.
+ * The magnitude is computed in unsigned arithmetic so that INT_MIN
+ * needs no special case.
+ */
+
+void Output::print(int value) {
+    char digits[16];
+    char *end = digits + sizeof digits;
+    char *p = end;
+    *--p = '\n';
+    unsigned magnitude = value < 0 ? 0u - unsigned(value) : unsigned(value);
+    do {
+        *--p = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) *--p = '-';
+    append(p, int(end - p));
+    if (policy == LINE_BUFFERED) flush();
+}
+
+void Output::write(const std::string &text) {
+    append(text.data(), int(text.size()));
+    if (policy == LINE_BUFFERED && !text.empty() && text.back() == '\n') flush();
+}
+
+void Output::flush() {
+    if (size > 0) {
+        std::fwrite(buffer, 1, size, stdout);
+        size = 0;
+    }
+    std::fflush(stdout);
+}
+
+void Output::setPolicy(FlushPolicy policy) {
+    this->policy = policy;
+}
+
+FlushPolicy Output::getPolicy() const {
+    return policy;
+}
+
+void Output::append(const char *text, int length) {
+    if (size + length > CAPACITY) {
+        flush();
+        if (length > CAPACITY) {
+            std::fwrite(text, 1, length, stdout);
+            return;
+        }
+    }
+    std::memcpy(buffer + size, text, length);
+    size += length;
+}
@@ -0,0 +1,103 @@
+/*
+ * File: output.hpp
+ * ----------------
+ * This interface exports the Output class, the buffered sink through
+ * which the interpreter writes everything it prints on the standard
+ * output.
+ */
+
+#ifndef _output_h
+#define _output_h
+
+#include <string>
+
+/*
+ * Type: FlushPolicy
+ * -----------------
+ * LINE_BUFFERED writes every completed line immediately, which is what
+ * an interactive user expects.  BLOCK_BUFFERED only writes when the
+ * buffer fills or when flush is called explicitly, which is much
+ * cheaper when the output goes to a pipe or a file.
+ */
+
+enum FlushPolicy {
+    LINE_BUFFERED, BLOCK_BUFFERED
+};
+
+/*
+ * Class: Output
+ * -------------
+ * A fixed-size output buffer in front of stdout.  The interpreter
+ * flushes it explicitly before it waits for input, after reporting an
+ * error and when a program ends, so the output always appears in the
+ * same order as it was produced.
+ */
+
+class Output {
+
+public:
+
+/*
+ * Constructor: Output
+ * Usage: Output output;
+ * ---------------------
+ * Creates an empty sink.  The policy is LINE_BUFFERED if stdout is a
+ * terminal and BLOCK_BUFFERED otherwise.
+ */
+
+    Output();
+
+/*
+ * Destructor: ~Output
+ * -------------------
+ * Flushes whatever is still buffered.
+ */
+
+    ~Output();
+
+/*
+ * Method: print
+ * Usage: output.print(value);
+ * ---------------------------
+ * Writes an integer followed by a newline, the way PRINT shows it.
+ * The conversion does not go through the iostream machinery.
+ */
+
+    void print(int value);
+
+/*
+ * Method: write
+ * Usage: output.write(text);
+ * --------------------------
+ * Appends text to the buffer.  Under LINE_BUFFERED the buffer is
+ * flushed if the text ends a line.
+ */
+
+    void write(const std::string &text);
+
+/*
+ * Method: flush
+ * Usage: output.flush();
+ * ----------------------
+ * Writes the buffered text to stdout.
+ */
+
+    void flush();
+
+    void setPolicy(FlushPolicy policy);
+
+    FlushPolicy getPolicy() const;
+
+private:
+
+    static const int CAPACITY = 1 << 16;
+
+    char buffer[CAPACITY];
+    int size = 0;
+    FlushPolicy policy;
+
+    void append(const char *text, int length);
+
+};
+
+#endif
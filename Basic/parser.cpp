@@ -4,7 +4,193 @@
  * Implements the parser.h interface.
  */
 
+#include "memstats.hpp"
 #include "parser.hpp"
+#include "statement.hpp"
+
+static std::shared_ptr<Statement> readStatement(commands cmd, Lexer &scanner, ExpArena &arena, EvalState &state);
+
+static int readOperand(Lexer &scanner, ExpArena &arena);
+
+static int readVariable(Lexer &scanner, EvalState &state);
+
+static int readLineNumber(Lexer &scanner);
+
+static void expect(Lexer &scanner, std::string_view text);
+
+static void expectEnd(Lexer &scanner);
+
+/*
+ * Function: newStatement
+ * Usage: std::shared_ptr<Let> stmt = newStatement<Let>();
+ * -------------------------------------------------------
+ * Allocates a statement and charges it to MEMORY_STATEMENTS.
+ */
+
+template <typename T>
+static std::shared_ptr<T> newStatement() {
+    MemoryScope scope(MEMORY_STATEMENTS);
+    return std::make_shared<T>();
+}
+
+/*
+ * Implementation notes: parseLine
+ * -------------------------------
+ * A leading number makes the line a program line; otherwise its first
+ * word names an immediate command.  Each statement is built while its
+ * syntax is being checked, so the line is lexed exactly once.  The
+ * expression parser reports more specific errors, which are all
+ * turned into SYNTAX ERROR here.
+ */
+
+ParsedLine parseLine(std::string_view line, ExpArena &arena, EvalState &state) {
+    MemoryScope scope(MEMORY_SCANNER);
+    Lexer scanner(line);
+    ParsedLine parsed;
+    try {
+        Token token = scanner.nextToken();
+        if (token.type == NUMBER) {
+            parsed.lineNumber = tokenToInteger(token.text);
+            token = scanner.nextToken();
+            if (token.empty()) return parsed;
+            parsed.cmd = commandOf(token.text);
+            if (parsed.cmd > IF) error("SYNTAX ERROR");
+            parsed.statement = readStatement(parsed.cmd, scanner, arena, state);
+            return parsed;
+        }
+        parsed.cmd = commandOf(token.text);
+        switch (parsed.cmd) {
+            case LET:
+            case PRINT:
+            case INPUT:
+                parsed.statement = readStatement(parsed.cmd, scanner, arena, state);
+                break;
+            case RUN:
+            case LIST:
+            case CLEAR:
+            case QUIT:
+            case HELP:
+            case PROFILE:
+            case MEMSTATS:
+                expectEnd(scanner);
+                break;
+            default:
+                error("SYNTAX ERROR");
+        }
+    } catch (ErrorException &) {
+        error("SYNTAX ERROR");
+    }
+    return parsed;
+}
+
+/*
+ * Implementation notes: readStatement
+ * -----------------------------------
+ * Reads the rest of a statement after its keyword.  The operands of
+ * LET, PRINT and IF are parsed above the precedence of =, so that the
+ * comparison in an IF ends its left operand and an assignment cannot
+ * appear inside a statement.
+ */
+
+static std::shared_ptr<Statement> readStatement(commands cmd, Lexer &scanner, ExpArena &arena, EvalState &state) {
+    switch (cmd) {
+        case REM:
+            return newStatement<Rem>();
+        case LET: {
+            std::shared_ptr<Let> stmt = newStatement<Let>();
+            stmt->var = readVariable(scanner, state);
+            expect(scanner, "=");
+            stmt->val = readOperand(scanner, arena);
+            expectEnd(scanner);
+            return stmt;
+        }
+        case PRINT: {
+            std::shared_ptr<Print> stmt = newStatement<Print>();
+            stmt->var = readOperand(scanner, arena);
+            expectEnd(scanner);
+            return stmt;
+        }
+        case INPUT: {
+            std::shared_ptr<Input> stmt = newStatement<Input>();
+            stmt->var = readVariable(scanner, state);
+            expectEnd(scanner);
+            return stmt;
+        }
+        case END:
+            expectEnd(scanner);
+            return newStatement<End>();
+        case GOTO: {
+            std::shared_ptr<Goto> stmt = newStatement<Goto>();
+            stmt->line = readLineNumber(scanner);
+            expectEnd(scanner);
+            return stmt;
+        }
+        case IF: {
+            std::shared_ptr<If> stmt = newStatement<If>();
+            stmt->lhs = readOperand(scanner, arena);
+            Token op = scanner.nextToken();
+            if (op != "=" && op != "<" && op != ">") error("SYNTAX ERROR");
+            stmt->op = op.text[0];
+            stmt->rhs = readOperand(scanner, arena);
+            expect(scanner, "THEN");
+            stmt->line_number = readLineNumber(scanner);
+            expectEnd(scanner);
+            return stmt;
+        }
+        default:
+            break;
+    }
+    error("SYNTAX ERROR");
+    return nullptr;
+}
+
+static int readOperand(Lexer &scanner, ExpArena &arena) {
+    return arena.simplify(readE(scanner, arena, precedence(ASSIGN)));
+}
+
+/*
+ * Implementation notes: readVariable
+ * ----------------------------------
+ * A variable is a word that is not one of the keywords.
+ */
+
+static int readVariable(Lexer &scanner, EvalState &state) {
+    Token token = scanner.nextToken();
+    if (token.type != WORD || token == "THEN" || commandOf(token.text) != NOT_A_COMMAND) {
+        error("SYNTAX ERROR");
+    }
+    return state.slotOf(token.str());
+}
+
+static int readLineNumber(Lexer &scanner) {
+    Token token = scanner.nextToken();
+    if (token.type != NUMBER) error("SYNTAX ERROR");
+    return tokenToInteger(token.text);
+}
+
+static void expect(Lexer &scanner, std::string_view text) {
+    if (scanner.nextToken() != text) error("SYNTAX ERROR");
+}
+
+static void expectEnd(Lexer &scanner) {
+    if (scanner.hasMoreTokens()) error("SYNTAX ERROR");
+}
+
+/*
+ * Implementation notes: commandOf
+ * -------------------------------
+ * The keywords are few, so they are simply compared in turn.
+ */
+
+commands commandOf(std::string_view token) {
+    static const std::string_view keywords[] = {
+            "REM", "LET", "PRINT", "INPUT", "END", "GOTO", "IF", "RUN", "LIST", "CLEAR", "QUIT", "HELP", "PROFILE", "MEMSTATS"
+    };
+    for (int i = 0; i < NOT_A_COMMAND; i++) {
+        if (token == keywords[i]) return commands(i);
+    }
+    return NOT_A_COMMAND;
+}
 
 
 /*
@@ -13,10 +199,10 @@
  * This code just reads an expression and then checks for extra tokens.
  */
 
-std::shared_ptr<Expression> parseExp(TokenScanner &scanner) {
-    std::shared_ptr<Expression> exp = readE(scanner);
+int parseExp(Lexer &scanner, ExpArena &arena) {
+    int exp = readE(scanner, arena);
     if (scanner.hasMoreTokens()) {
-        error("parseExp: Found extra token: " + scanner.nextToken());
+        error("parseExp: Found extra token: " + scanner.nextToken().str());
     }
     return exp;
 }
@@ -32,15 +218,16 @@ std::shared_ptr<Expression> parseExp(TokenScanner &scanner) {
  * readE calls itself recursively to read in that subexpression as a unit.
  */
 
-std::shared_ptr<Expression> readE(TokenScanner &scanner, int prec) {
-    std::shared_ptr<Expression> exp = readT(scanner);
-    std::string token;
+int readE(Lexer &scanner, ExpArena &arena, int prec) {
+    int exp = readT(scanner, arena);
+    Token token;
     while (true) {
         token = scanner.nextToken();
-        int newPrec = precedence(token);
+        Operator op = operatorOf(token.text);
+        int newPrec = precedence(op);
         if (newPrec <= prec) break;
-        std::shared_ptr<Expression> rhs = readE(scanner, newPrec);
-        exp = std::make_shared<CompoundExp>(token, exp, rhs);
+        int rhs = readE(scanner, arena, newPrec);
+        exp = arena.compound(op, exp, rhs);
     }
     scanner.saveToken(token);
     return exp;
@@ -50,17 +237,20 @@ std::shared_ptr<Expression> readE(TokenScanner &scanner, int prec) {
  * Implementation notes: readT
  * ---------------------------
  * This function scans a term, which is either an integer, an identifier,
- * or a parenthesized subexpression.
+ * a negated term, or a parenthesized subexpression.  Unary minus binds
+ * tighter than every binary operator, so -1 + 2 is 1.
  */
 
-std::shared_ptr<Expression> readT(TokenScanner &scanner) {
-    std::string token = scanner.nextToken();
-    TokenType type = scanner.getTokenType(token);
-    if (type == WORD) return std::make_shared<IdentifierExp>(token);
-    if (type == NUMBER) return std::make_shared<ConstantExp>(stringToInteger(token));
-    if (token == "-") return std::make_shared<CompoundExp>(token, std::make_shared<ConstantExp>(0), readE(scanner));
+int readT(Lexer &scanner, ExpArena &arena) {
+    Token token = scanner.nextToken();
+    if (token.type == WORD) return arena.identifier(token.str());
+    if (token.type == NUMBER) return arena.constant(tokenToInteger(token.text));
+    if (token == "-") {
+        int zero = arena.constant(0);
+        return arena.compound(MINUS, zero, readT(scanner, arena));
+    }
     if (token != "(") error("Illegal term in expression");
-    std::shared_ptr<Expression> exp = readE(scanner);
+    int exp = readE(scanner, arena);
     if (scanner.nextToken() != ")") {
         error("Unbalanced parentheses in expression");
     }
@@ -70,13 +260,10 @@ std::shared_ptr<Expression> readT(TokenScanner &scanner) {
 /*
  * Implementation notes: precedence
  * --------------------------------
- * This function checks the token against each of the defined operators
- * and returns the appropriate precedence value.
+ * This function looks the operator up in a table indexed by Operator.
  */
 
-int precedence(std::string token) {
-    if (token == "=") return 1;
-    if (token == "+" || token == "-") return 2;
-    if (token == "*" || token == "/") return 3;
-    return 0;
+int precedence(Operator op) {
+    static const int table[] = {1, 2, 2, 3, 3, 0};
+    return table[op];
 }
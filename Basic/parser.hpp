@@ -8,55 +8,107 @@
 #define _parser_h
 
 
+#include <memory>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include "exp.hpp"
 
-#include "Utils/tokenScanner.hpp"
+#include "Utils/lexer.hpp"
 #include "Utils/error.hpp"
 #include "Utils/strlib.hpp"
 
+class Statement;
+
+/*
+ * Type: commands
+ * --------------
+ * The statements and commands a line can start with.  NOT_A_COMMAND is
+ * returned by commandOf for words that are not keywords.
+ */
+
+enum commands {
+    REM, LET, PRINT, INPUT, END, GOTO, IF, RUN, LIST, CLEAR, QUIT, HELP, PROFILE, MEMSTATS, NOT_A_COMMAND
+};
+
+/*
+ * Type: ParsedLine
+ * ----------------
+ * The result of parsing one line of input.  lineNumber is -1 for an
+ * immediate command.  statement holds the built statement for LET,
+ * PRINT and INPUT commands and for every program line except one that
+ * consists of a line number alone, which asks for that line to be
+ * deleted.
+ */
+
+struct ParsedLine {
+    int lineNumber = -1;
+    commands cmd = NOT_A_COMMAND;
+    std::shared_ptr<Statement> statement;
+};
+
+/*
+ * Function: parseLine
+ * Usage: ParsedLine parsed = parseLine(line, arena, state);
+ * ---------------------------------------------------------
+ * Parses a line entered by the user in a single left-to-right scan,
+ * checking its syntax and building its statement at the same time.
+ * Expression nodes are appended to the arena and variables are bound
+ * to slots of the state.  Every kind of malformed line raises
+ * SYNTAX ERROR.
+ */
+
+ParsedLine parseLine(std::string_view line, ExpArena &arena, EvalState &state);
+
+/*
+ * Function: commandOf
+ * Usage: commands cmd = commandOf(token);
+ * ---------------------------------------
+ * Returns the command a keyword names, or NOT_A_COMMAND.
+ */
+
+commands commandOf(std::string_view token);
 
 /*
  * Function: parseExp
- * Usage: Expression *exp = parseExp(scanner);
- * -------------------------------------------
+ * Usage: int exp = parseExp(scanner, arena);
+ * ------------------------------------------
  * Parses an expression by reading tokens from the scanner, which must
- * be provided by the client.  The scanner should be set to ignore
- * whitespace and to scan numbers.
+ * be provided by the client, and appends its nodes to the arena.  The
+ * return value is the index of the root node.
  */
 
-std::shared_ptr<Expression> parseExp(TokenScanner &scanner);
+int parseExp(Lexer &scanner, ExpArena &arena);
 
 /*
  * Function: readE
- * Usage: Expression *exp = readE(scanner, prec);
+ * Usage: int exp = readE(scanner, arena, prec);
  * ----------------------------------------------
  * Returns the next expression from the scanner involving only operators
  * whose precedence is at least prec.  The prec argument is optional and
  * defaults to 0, which means that the function reads the entire expression.
  */
 
-std::shared_ptr<Expression> readE(TokenScanner &scanner, int prec = 0);
+int readE(Lexer &scanner, ExpArena &arena, int prec = 0);
 
 /*
  * Function: readT
- * Usage: Expression *exp = readT(scanner);
+ * Usage: int exp = readT(scanner, arena);
  * ----------------------------------------
  * Returns the next individual term, which is either a constant, an
- * identifier, or a parenthesized subexpression.
+ * identifier, a negated term, or a parenthesized subexpression.
  */
 
-std::shared_ptr<Expression> readT(TokenScanner &scanner);
+int readT(Lexer &scanner, ExpArena &arena);
 
 /*
  * Function: precedence
- * Usage: int prec = precedence(token);
- * ------------------------------------
- * Returns the precedence of the specified operator token.  If the token
- * is not an operator, precedence returns 0.
+ * Usage: int prec = precedence(op);
+ * ---------------------------------
+ * Returns the precedence of the specified operator.  If the token
+ * was not an operator (NOT_AN_OPERATOR), precedence returns 0.
  */
 
-int precedence(std::string token);
+int precedence(Operator op);
 
 #endif
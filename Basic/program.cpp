@@ -1,173 +1,630 @@
 /*
  * File: program.cpp
  * -----------------
- * This file is a stub implementation of the program.h interface
- * in which none of the methods do anything beyond returning a
- * value of the correct type.  Your job is to fill in the bodies
- * of each of these methods with an implementation that satisfies
- * the performance guarantees specified in the assignment.
+ * This file implements the program.h interface: editing the line
+ * table, running the program on the selected engine, and the memory,
+ * compile, promotion and profile reports.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include "memstats.hpp"
 #include "program.hpp"
+#include "sampler.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
-int find_cmp(const std::string &in) {
-    int position = 0;
-    while (position < in.size()) {
-        char ch = in[position];
-        if (ch == '=' || ch == '<' || ch == '>') {
-            return position;
-        }
-        position++;
-    }
-    return -1;
+Program::Program(EvalState &state1) : arena(state1), state(state1) {}
+
+Program::~Program() = default;
+
+void Program::clear() {
+    Clear();
 }
 
-std::shared_ptr<Expression> formula(std::string fml) {
-    while (fml[0] == ' ') {
-        fml = fml.substr(1);
+ParsedLine Program::parse(const std::string &line) {
+    int begin = arena.size();
+    ParsedLine parsed;
+    try {
+        parsed = parseLine(line, arena, state);
+    } catch (ErrorException &) {
+        arena.truncate(begin);
+        throw;
+    }
+    if (parsed.statement) {
+        parsed.statement->expBegin = begin;
+        parsed.statement->expEnd = arena.size();
     }
-    TokenScanner scanner;
-    scanner.ignoreWhitespace();
-    scanner.scanNumbers();
-    scanner.setInput(fml);
-    return parseExp(scanner);
+    return parsed;
 }
 
-Program::Program(EvalState &state1) : state(state1) {}
+/*
+ * Implementation notes: addSourceLine
+ * -----------------------------------
+ * The new statement is stored before the old one is counted as
+ * garbage, so that a compaction triggered here moves its nodes along
+ * with those of the other live statements.
+ */
 
-Program::~Program() = default;
+void Program::addSourceLine(int lineNumber, const std::string &line, std::shared_ptr<Statement> statement) {
+    std::shared_ptr<Statement> old;
+    {
+        MemoryScope scope(MEMORY_SOURCE);
+        old = lines.insert({lineNumber, line, std::move(statement)});
+    }
+    edited(lineNumber, old != nullptr);
+    if (old) {
+        garbage += old->expEnd - old->expBegin;
+    }
+    reclaim();
+}
 
-void Program::clear() {
-    list.clear();
-    run.clear();
-}
-
-void Program::addSourceLine(int lineNumber, std::string &line, commands cmd) {
-    if (list.find(lineNumber) != list.end()) {
-        removeSourceLine(lineNumber);
-    }
-    list[lineNumber] = line;
-
-    TokenScanner scanner2;
-    scanner2.ignoreWhitespace();
-    scanner2.scanNumbers();
-    scanner2.setInput(line);
-    if (lineNumber != -1) {
-        scanner2.nextToken();
-    }
-    scanner2.nextToken();
-    if (cmd == REM) {
-        std::shared_ptr<Rem> tem = std::make_shared<Rem>();
-        run[lineNumber] = tem;
-    } else if (cmd == LET) {
-        line = line.substr(line.find('T') + 1);
-        std::shared_ptr<Let> tem = std::make_shared<Let>();
-        std::string fml = line.substr(line.find('=') + 2);
-        tem->var.name = scanner2.nextToken();
-        tem->val = formula(fml);
-        run[lineNumber] = tem;
-    } else if (cmd == PRINT) {
-        line = line.substr(line.find('T') + 1);
-        std::shared_ptr<Print> tem = std::make_shared<Print>();
-        tem->var = formula(line);
-        run[lineNumber] = tem;
-    } else if (cmd == INPUT) {
-        std::shared_ptr<Input> tem = std::make_shared<Input>();
-        tem->var.name = scanner2.nextToken();
-        run[lineNumber] = tem;
-    } else if (cmd == END) {
-        std::shared_ptr<End> tem = std::make_shared<End>();
-        run[lineNumber] = tem;
-    } else if (cmd == GOTO) {
-        std::shared_ptr<Goto> tem = std::make_shared<Goto>();
-        tem->line = stringToInteger(scanner2.nextToken());
-        run[lineNumber] = tem;
-    } else if (cmd == IF) {
-        int lhs_begin = line.find('F') + 1;
-        int op_position = find_cmp(line);
-        int rhs_end = line.find('T') - 1;
-        std::string lhs = line.substr(lhs_begin, op_position - lhs_begin),
-                rhs = line.substr(op_position + 1, rhs_end - op_position);
-        std::shared_ptr<If> tem = std::make_shared<If>();
-        tem->op = line[op_position];
-        while (scanner2.nextToken() != "THEN") {
+/*
+ * Implementation notes: loadSourceLines
+ * -------------------------------------
+ * Lines beyond the end of the program are appended to the store
+ * without a search, which makes building a program from scratch
+ * linear.  Compaction is postponed to the end, when every new
+ * statement is in place.
+ */
+
+void Program::loadSourceLines(std::vector<SourceLine> &loaded) {
+    for (SourceLine &line: loaded) {
+        int number = line.number;
+        std::shared_ptr<Statement> old;
+        {
+            MemoryScope scope(MEMORY_SOURCE);
+            old = lines.insert(std::move(line));
+        }
+        edited(number, old != nullptr);
+        if (old) {
+            garbage += old->expEnd - old->expBegin;
         }
-        tem->line_number = stringToInteger(scanner2.nextToken());
-        scanner2.setInput(lhs);
-        tem->lhs = parseExp(scanner2);
-        scanner2.setInput(rhs);
-        tem->rhs = parseExp(scanner2);
-        run[lineNumber] = tem;
     }
+    loaded.clear();
+    reclaim();
 }
 
 void Program::removeSourceLine(int lineNumber) {
-    if (list.find(lineNumber) == list.end()) {
+    std::shared_ptr<Statement> statement = lines.erase(lineNumber);
+    if (!statement) {
         return;
     }
-    list.erase(lineNumber);
-    run.erase(lineNumber);
+    edited(lineNumber, false);
+    garbage += statement->expEnd - statement->expBegin;
+    reclaim();
 }
 
-std::string Program::getSourceLine(int lineNumber) {
-    if (list.find(lineNumber) == list.end()) {
-        error("LINE NUMBER ERROR");
+/*
+ * Implementation notes: execute
+ * -----------------------------
+ * Nothing has been added to the arena since the statement was parsed,
+ * so its nodes are the last ones and truncating the arena frees them
+ * without leaving garbage behind.
+ */
+
+void Program::execute(Statement &statement) {
+    try {
+        statement.execute(state, *this);
+    } catch (ErrorException &) {
+        arena.truncate(statement.expBegin);
+        throw;
+    }
+    arena.truncate(statement.expBegin);
+}
+
+/*
+ * Implementation notes: edited
+ * ----------------------------
+ * Every change to the lines is reported to the compile cache.  The
+ * linked statements can be patched as long as the lines keep their
+ * positions, which replacing a line does; adding or removing one
+ * shifts the positions of all later lines and forces a full link.
+ */
+
+void Program::edited(int lineNumber, bool replaced) {
+    cache.invalidate(lineNumber);
+    if (replaced) {
+        relinks.push_back(lineNumber);
+    } else {
+        reshaped = true;
+    }
+}
+
+/*
+ * Implementation notes: reclaim
+ * -----------------------------
+ * Replacing or removing a line leaves its expression nodes behind in
+ * the arena.  Once they make up more than half of it, the live ranges
+ * are slid down over the holes in one pass, in arena order, and the
+ * statements are told how far their nodes moved.
+ */
+
+void Program::reclaim() {
+    if (garbage < 1024 || garbage * 2 < arena.size()) {
+        return;
+    }
+    std::vector<Statement *> order;
+    for (const SourceLine &line: lines) {
+        order.push_back(line.statement.get());
+    }
+    std::sort(order.begin(), order.end(), [](Statement *a, Statement *b) {
+        return a->expBegin < b->expBegin;
+    });
+    int top = 0;
+    for (Statement *statement: order) {
+        int size = statement->expEnd - statement->expBegin;
+        arena.relocate(statement->expBegin, statement->expEnd, top);
+        statement->relocate(top - statement->expBegin);
+        top += size;
     }
-    return list[lineNumber];
+    arena.truncate(top);
+    garbage = 0;
 }
 
-void Program::setParsedStatement(int lineNumber, Statement *stmt) {
+std::string Program::getSourceLine(int lineNumber) {
+    SourceLine *line = lines.find(lineNumber);
+    if (line == nullptr) {
+        error("LINE NUMBER ERROR");
+    }
+    return line->text;
 }
 
 std::shared_ptr<Statement> Program::getParsedStatement(int lineNumber) {
-    if (run.find(lineNumber) == run.end()) {
+    SourceLine *line = lines.find(lineNumber);
+    if (line == nullptr) {
         throw ErrorException("LINE NUMBER ERROR");
     }
-    return run[lineNumber];
+    return line->statement;
 }
 
 int Program::getFirstLineNumber() {
-    return run.begin()->first;
+    return lines.empty() ? -1 : lines.begin()->number;
 }
 
 int Program::getNextLineNumber(int lineNumber) {
-    auto this_line = run.find(lineNumber);
-    if (this_line == run.end()) {
+    if (lines.find(lineNumber) == nullptr) {
         throw ErrorException("LINE NUMBER ERROR");
     }
-    this_line++;
-    if (this_line == run.end()) {
-        end = true;
+    SourceLine *next = lines.next(lineNumber);
+    return next == nullptr ? -1 : next->number;
+}
+
+int Program::indexOf(int lineNumber) {
+    auto position = std::lower_bound(numbers.begin(), numbers.end(), lineNumber);
+    if (position == numbers.end() || *position != lineNumber) {
         return -1;
     }
-    return this_line->first;
+    return int(position - numbers.begin());
+}
+
+/*
+ * Implementation notes: reportMemory
+ * ----------------------------------
+ * The statement objects are counted at their own size; the shared_ptr
+ * control block that make_shared places next to each one adds another
+ * 16 bytes that the standard gives no way to measure.
+ */
+
+void Program::reportMemory(std::ostream &out) {
+    size_t store = lines.bytes(), statements = 0;
+    for (const SourceLine &line: lines) {
+        statements += line.statement->footprint();
+    }
+    size_t expressions = arena.bytes();
+    int count = lines.size();
+    auto row = [&](const char *name, size_t bytes) {
+        out << "  " << name << bytes << " bytes";
+        if (count > 0) out << " (" << std::fixed << std::setprecision(1) << double(bytes) / count << " per line)";
+        out << '\n';
+    };
+    out << "program: " << count << " lines\n";
+    row("line store:  ", store);
+    row("statements:  ", statements);
+    row("expressions: ", expressions);
+    row("total:       ", store + statements + expressions);
+}
+
+/*
+ * Implementation notes: reportHeap
+ * --------------------------------
+ * The live sizes come from the structures themselves, since the heap
+ * counters only know the category of a block when it is allocated.
+ * Scanner temporaries are freed by the time a line is parsed, so they
+ * have no live size.  Whatever the heap holds beyond the four measured
+ * structures is shown as other.  Without accounting only the sizes of
+ * the structures are known, and the heap totals are left out.
+ */
+
+void Program::reportHeap(std::ostream &out) {
+    size_t statements = 0;
+    for (const SourceLine &line: lines) {
+        statements += line.statement->footprint();
+    }
+    long long sizes[MEMORY_CATEGORIES] = {};
+    sizes[MEMORY_SOURCE] = (long long) lines.bytes();
+    sizes[MEMORY_STATEMENTS] = (long long) statements;
+    sizes[MEMORY_EXPRESSIONS] = (long long) arena.bytes();
+    sizes[MEMORY_SYMBOLS] = (long long) state.bytes();
+    bool counted = memoryAccounting();
+    HeapStats heap = heapStats();
+    sizes[MEMORY_OTHER] = heap.live;
+    for (int category = MEMORY_SOURCE; category < MEMORY_CATEGORIES; category++) {
+        sizes[MEMORY_OTHER] -= sizes[category];
+    }
+    sizes[MEMORY_OTHER] = std::max(0LL, sizes[MEMORY_OTHER]);
+    if (counted) {
+        out << "heap: " << heap.live << " bytes live, " << heap.peak << " peak, "
+            << heap.allocations << " allocations, " << heap.frees << " frees\n";
+    } else {
+        out << "heap: not counted, run with --memstats for the totals\n";
+    }
+    out << "  " << std::left << std::setw(14) << "category" << std::right << std::setw(14) << "live bytes"
+        << std::setw(14) << "allocations" << std::setw(17) << "bytes allocated" << '\n';
+    static const MemoryCategory order[] = {
+            MEMORY_SOURCE, MEMORY_STATEMENTS, MEMORY_EXPRESSIONS, MEMORY_SYMBOLS, MEMORY_SCANNER, MEMORY_OTHER
+    };
+    for (MemoryCategory category: order) {
+        MemoryCounters counters = memoryCounters(category);
+        out << "  " << std::left << std::setw(14) << categoryName(category) << std::right << std::setw(14);
+        if (category == MEMORY_SCANNER || (category == MEMORY_OTHER && !counted)) {
+            out << "-";
+        } else {
+            out << sizes[category];
+        }
+        if (counted) {
+            out << std::setw(14) << counters.allocations << std::setw(17) << counters.bytes << '\n';
+        } else {
+            out << std::setw(14) << "-" << std::setw(17) << "-" << '\n';
+        }
+    }
+}
+
+void Program::MemStats() {
+    std::ostringstream report;
+    reportHeap(report);
+    output.write(report.str());
+    output.flush();
 }
 
 void Program::List() {
-    for (const auto &line: list) {
-        std::cout << line.second << '\n';
+    for (const SourceLine &line: lines) {
+        output.write(line.text);
+        output.write("\n");
     }
 }
 
 void Program::Clear() {
-    list.clear();
-    run.clear();
+    lines.clear();
+    arena.clear();
+    cache.clear();
+    jitStale = true;
+    reshaped = true;
+    relinks.clear();
+    garbage = 0;
 }
 
 void Program::Run() {
-    if (list.empty()) {
+    if (lines.empty()) {
+        return;
+    }
+    runs++;
+    if (profiling || sampler != nullptr) {
+        profiled();
+    } else if (engine == TREE_ENGINE) {
+        walk();
+    } else if (engine == TIERED_ENGINE) {
+        tiered();
+    } else {
+        compile();
+        if (engine == JIT_ENGINE && native()) {
+            jit.run(state, output);
+        } else {
+            vm.run(image, state, output);
+        }
+    }
+    output.flush();
+}
+
+void Program::Profile() {
+    profile.clear();
+    bool enabled = profiling;
+    profiling = true;
+    try {
+        Run();
+    } catch (ErrorException &) {
+        profiling = enabled;
+        throw;
+    }
+    profiling = enabled;
+    std::ostringstream report;
+    reportProfile(report);
+    output.write(report.str());
+    output.flush();
+}
+
+/*
+ * Implementation notes: compile
+ * -----------------------------
+ * Brings the compiled program up to date and removes the checks of the
+ * reads that the definite-assignment analysis proves safe.  The
+ * analysis starts from the variables defined at this moment, which is
+ * sound for the rest of the run because variables are never undefined
+ * while it goes on.  It also stays sound for later runs of the same
+ * image, since only CLEAR undefines variables and CLEAR empties the
+ * cache.
+ */
+
+void Program::compile() {
+    if (!cache.update(lines, arena, image)) return;
+    analysis.analyze(image, state);
+    analysis.apply(image);
+    jitStale = true;
+}
+
+/*
+ * Implementation notes: native
+ * ----------------------------
+ * Translates the compiled program to native code unless that has
+ * already been done, or tried, for the current image.
+ */
+
+bool Program::native() {
+    if (jitStale) {
+        jitReady = jit.compile(image);
+        jitStale = false;
+    }
+    return jitReady;
+}
+
+/*
+ * Implementation notes: definedAt
+ * -------------------------------
+ * The instructions are emitted in line order, so the source line
+ * numbers of the image are sorted and the first instruction at or
+ * after the line is the one that runs when it starts, also for a line
+ * that emits no code.  Compiling on demand is what the next RUN on the
+ * VM would do anyway, and the tree walker never looks at the image.
+ */
+
+std::vector<std::string> Program::definedAt(int lineNumber) {
+    std::vector<std::string> names;
+    if (lines.find(lineNumber) == nullptr) return names;
+    compile();
+    auto position = std::lower_bound(image.lines.begin(), image.lines.end(), lineNumber);
+    if (position == image.lines.end()) return names;
+    for (int slot: analysis.definedAt(int(position - image.lines.begin()))) {
+        names.push_back(state.nameOf(slot));
+    }
+    return names;
+}
+
+const DefiniteAssignment &Program::assignment() {
+    if (!lines.empty()) compile();
+    return analysis;
+}
+
+/*
+ * Implementation notes: link
+ * --------------------------
+ * The link phase numbers the statements densely in line order and
+ * lets every statement replace the line numbers it jumps to by those
+ * indices, so that executing a step costs no map lookup.  A jump to a
+ * line that does not exist is linked to -1; the statement reports
+ * LINE NUMBER ERROR only if the jump is actually taken, as the
+ * reference interpreter does.  If lines have only been replaced since
+ * the last link, every index is still valid and only the replacement
+ * statements are linked.
+ */
+
+void Program::link() {
+    if (!reshaped) {
+        for (int number: relinks) {
+            int index = indexOf(number);
+            linked[index] = lines.find(number)->statement.get();
+            linked[index]->next = index + 1 < int(linked.size()) ? index + 1 : -1;
+            linked[index]->link(*this);
+        }
+        relinks.clear();
         return;
     }
-    end = false;
-    line_now = getFirstLineNumber();
-    while (!end) {
-        getParsedStatement(line_now)->execute(state, *this);
+    reshaped = false;
+    relinks.clear();
+    numbers.clear();
+    linked.clear();
+    for (const SourceLine &line: lines) {
+        numbers.push_back(line.number);
+        linked.push_back(line.statement.get());
+    }
+    for (int i = 0; i < int(linked.size()); i++) {
+        linked[i]->next = i + 1 < int(linked.size()) ? i + 1 : -1;
+        linked[i]->link(*this);
+    }
+}
+
+/*
+ * Implementation notes: walk
+ * --------------------------
+ * The tree-walking engine executes the parsed statements directly.
+ * It is kept next to the VM so that the two can be compared on the
+ * same input.
+ */
+
+void Program::walk() {
+    link();
+    pc = 0;
+    while (pc >= 0) {
+        linked[pc]->execute(state, *this);
+    }
+}
+
+/*
+ * Function: ticks
+ * Usage: uint64_t now = ticks();
+ * ------------------------------
+ * Reads the cheapest clock available: the time-stamp counter on x86,
+ * and the steady clock in nanoseconds elsewhere.
+ */
+
+static inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+/*
+ * Implementation notes: profiled
+ * ------------------------------
+ * The profiled walker reads the clock once per statement and charges
+ * the ticks since the previous reading to the statement that just ran,
+ * so that the time of a line includes the jump that ends it.  Ticks are
+ * converted to time once at the end, by the ratio of the ticks to the
+ * steady clock over the whole run.  The counts are kept by link index
+ * during the run and merged into the profile by line number when it
+ * ends, even when it ends with an error.  With a sampler the walker
+ * also tells it which line runs, and the arena which nodes are being
+ * evaluated, for the duration of the run.  Both clocks are read after
+ * the sampler has started and before it is stopped, so that neither
+ * its set-up nor collecting its samples is charged to a line.
+ */
+
+void Program::profiled() {
+    link();
+    std::vector<long long> counts(linked.size(), 0);
+    std::vector<uint64_t> spent(linked.size(), 0);
+    if (sampler != nullptr) {
+        arena.setSampler(sampler);
+        sampler->start();
+    }
+    auto started = std::chrono::steady_clock::now();
+    uint64_t first = ticks(), last = first;
+    auto record = [&]() {
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - started;
+        uint64_t end = ticks();
+        if (sampler != nullptr) {
+            sampler->stop();
+            arena.setSampler(nullptr);
+            sampler->collect(*this);
+        }
+        double scale = end > first ? elapsed.count() / double(end - first) : 0;
+        for (size_t i = 0; i < linked.size(); i++) {
+            if (counts[i] == 0) continue;
+            LineProfile &line = profile[numbers[i]];
+            line.count += counts[i];
+            line.nanoseconds += double(spent[i]) * scale;
+            line.text = getSourceLine(numbers[i]);
+        }
+    };
+    pc = 0;
+    try {
+        while (pc >= 0) {
+            int current = pc;
+            if (sampler != nullptr) sampler->enter(numbers[current]);
+            linked[current]->execute(state, *this);
+            uint64_t now = ticks();
+            counts[current]++;
+            spent[current] += now - last;
+            last = now;
+        }
+    } catch (ErrorException &) {
+        record();
+        throw;
     }
+    record();
 }
 
-void Program::get_state(EvalState &state_in) {
-    state = state_in;
+void Program::reportProfile(std::ostream &out) {
+    std::vector<std::pair<int, const LineProfile *>> order;
+    long long statements = 0;
+    double total = 0;
+    for (const auto &entry: profile) {
+        order.emplace_back(entry.first, &entry.second);
+        statements += entry.second.count;
+        total += entry.second.nanoseconds;
+    }
+    std::stable_sort(order.begin(), order.end(), [](const auto &a, const auto &b) {
+        return a.second->nanoseconds > b.second->nanoseconds;
+    });
+    out << "profile: " << statements << " statements in " << std::fixed << std::setprecision(3)
+        << total / 1e6 << " ms\n";
+    out << std::setw(10) << "line" << std::setw(14) << "count" << std::setw(12) << "ms"
+        << std::setw(8) << "share" << "  source\n";
+    for (const auto &entry: order) {
+        const LineProfile &line = *entry.second;
+        out << std::setw(10) << entry.first << std::setw(14) << line.count
+            << std::setw(12) << std::setprecision(3) << line.nanoseconds / 1e6
+            << std::setw(7) << std::setprecision(1) << (total > 0 ? 100 * line.nanoseconds / total : 0.0)
+            << "%  " << line.text << '\n';
+    }
+}
+
+/*
+ * Implementation notes: tiered
+ * ----------------------------
+ * The tiered engine walks the statements like walk does, counting how
+ * often every line executes and how often every line is the target of
+ * a jump backwards.  Since link numbers the lines in order, a jump is
+ * backwards exactly when it lands on an index not above the current
+ * one.  When a loop head collects tierThreshold such jumps the program
+ * is compiled and execution continues at that head in the compiled
+ * tier, with the variables exactly as the walker left them.  Programs
+ * that never loop are thus never compiled at all.
+ */
+
+void Program::tiered() {
+    auto started = std::chrono::steady_clock::now();
+    link();
+    executions.assign(linked.size(), 0);
+    backEdges.assign(linked.size(), 0);
+    long long steps = 0;
+    pc = 0;
+    while (pc >= 0) {
+        int current = pc;
+        executions[current]++;
+        linked[current]->execute(state, *this);
+        steps++;
+        if (pc >= 0 && pc <= current && ++backEdges[pc] >= tierThreshold) {
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - started;
+            promote(pc, current, steps, elapsed.count());
+            return;
+        }
+    }
+}
+
+void Program::promote(int head, int from, long long steps, double milliseconds) {
+    compile();
+    bool compiled = native();
+    promotions.push_back({runs, numbers[head], numbers[from], executions[head], steps, milliseconds,
+                          compiled ? "jit" : "vm"});
+    if (compiled) {
+        jit.run(state, output, image.starts[head]);
+    } else {
+        vm.run(image, state, output, image.starts[head]);
+    }
 }
 
+void Program::reportCompiles(std::ostream &out) {
+    const CompileStats &stats = cache.stats();
+    out << "compiles: " << stats.builds << " builds, " << stats.hits << " reused images; "
+        << stats.compiled << " lines compiled, " << stats.reused << " reused\n";
+}
 
+const CompileStats &Program::compileStats() const {
+    return cache.stats();
+}
 
+void Program::reportPromotions(std::ostream &out) {
+    out << "promotions: " << promotions.size() << '\n';
+    for (const Promotion &promotion: promotions) {
+        out << "  run " << promotion.run << ": line " << promotion.head
+            << " (back edge from " << promotion.from << ") to " << promotion.tier
+            << " after " << promotion.steps << " steps, " << std::fixed << std::setprecision(3)
+            << promotion.milliseconds << " ms; head executed " << promotion.executions << " times\n";
+    }
+}
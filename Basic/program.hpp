@@ -10,21 +10,71 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <set>
 #include <unordered_map>
+#include "parser.hpp"
 #include "statement.hpp"
+#include "vm.hpp"
+#include "jit.hpp"
+#include "dataflow.hpp"
+#include "linestore.hpp"
+#include "output.hpp"
 #include <memory>
+#include <ostream>
 
-int find_cmp(const std::string &in);
+/*
+ * Type: Engine
+ * ------------
+ * Selects how RUN executes the program: by compiling it to bytecode
+ * for the VM, by walking the parsed statements, or by translating the
+ * bytecode further into native code.  JIT_ENGINE falls back to the VM
+ * for programs the code generator does not handle.  TIERED_ENGINE, the
+ * default, starts walking the statements and moves to native code or
+ * the VM once a loop turns out to be hot.
+ */
+
+enum Engine {
+    VM_ENGINE, TREE_ENGINE, JIT_ENGINE, TIERED_ENGINE
+};
+
+/*
+ * Type: Promotion
+ * ---------------
+ * Records one move of a running program from the tree walker to a
+ * compiled tier: the loop head whose backward jumps crossed the
+ * threshold, the line the last of them came from, how often the walker
+ * had executed the head, how long the RUN had been going and how many
+ * statements the walker had executed by then.
+ */
 
-enum commands {
-    REM, LET, PRINT, INPUT, END, GOTO, IF, RUN, LIST, CLEAR, QUIT, HELP
+struct Promotion {
+    int run;
+    int head;
+    int from;
+    long long executions;
+    long long steps;
+    double milliseconds;
+    const char *tier;
 };
 
-std::shared_ptr<Expression> formula(std::string fml);
+/*
+ * Type: LineProfile
+ * -----------------
+ * What the profiler recorded for one line: how often it executed, the
+ * time spent executing it, and its text when it last ran.
+ */
+
+struct LineProfile {
+    long long count = 0;
+    double nanoseconds = 0;
+    std::string text;
+};
 
 class Statement;
 
+class Sampler;
+
 /*
  * This class stores the lines in a BASIC program.  Each line
  * in the program is stored in order according to its line number.
@@ -70,17 +120,41 @@ public:
     void clear();
 
 /*
- * Method: addSourceLine
- * Usage: program.addSourceLine(lineNumber, line);
+ * Method: parse
+ * Usage: ParsedLine parsed = program.parse(line);
  * -----------------------------------------------
- * Adds a source line to the program with the specified line number.
- * If that line already exists, the text of the line replaces
- * the text of any existing line and the parsed representation
- * (if any) is deleted.  If the line is new, it is added to the
- * program in the correct sequence.
+ * Parses a line entered by the user into the program's expression
+ * arena.  If the line is malformed, the nodes it produced are
+ * discarded again and SYNTAX ERROR is raised.
  */
 
-    void addSourceLine(int lineNumber, std::string &line, commands);
+    ParsedLine parse(const std::string &line);
+
+/*
+ * Method: addSourceLine
+ * Usage: program.addSourceLine(lineNumber, line, statement);
+ * ----------------------------------------------------------
+ * Adds a source line and the statement parse built for it to the
+ * program with the specified line number.  If that line already
+ * exists, the text of the line replaces the text of any existing line
+ * and the parsed representation (if any) is deleted.  If the line is
+ * new, it is added to the program in the correct sequence.
+ */
+
+    void addSourceLine(int lineNumber, const std::string &line, std::shared_ptr<Statement> statement);
+
+/*
+ * Method: loadSourceLines
+ * Usage: program.loadSourceLines(lines);
+ * --------------------------------------
+ * Adds many lines at once, with the same effect as calling
+ * addSourceLine for each of them.  The lines must be sorted by number
+ * and hold each number at most once, and the nodes of their
+ * statements must already be in the arena.  The lines are moved out
+ * of the vector.
+ */
+
+    void loadSourceLines(std::vector<SourceLine> &lines);
 
 /*
  * Method: removeSourceLine
@@ -94,6 +168,18 @@ public:
 
     void removeSourceLine(int lineNumber);
 
+/*
+ * Method: execute
+ * Usage: program.execute(*parsed.statement);
+ * ------------------------------------------
+ * Executes a statement entered without a line number.  The statement
+ * must be the one most recently returned by parse and is never stored
+ * in the program; the arena space of its expressions is released
+ * afterwards, also if it raises an error.
+ */
+
+    void execute(Statement &statement);
+
 /*
  * Method: getSourceLine
  * Usage: string line = program.getSourceLine(lineNumber);
@@ -104,18 +190,6 @@ public:
 
     std::string getSourceLine(int lineNumber);
 
-/*
- * Method: setParsedStatement
- * Usage: program.setParsedStatement(lineNumber, stmt);
- * ----------------------------------------------------
- * Adds the parsed representation of the statement to the statement
- * at the specified line number.  If no such line exists, this
- * method raises an error.  If a previous parsed representation
- * exists, the memory for that statement is reclaimed.
- */
-
-    void setParsedStatement(int lineNumber, Statement *stmt);
-
 /*
  * Method: getParsedStatement
  * Usage: Statement *stmt = program.getParsedStatement(lineNumber);
@@ -148,22 +222,220 @@ public:
 
     int getNextLineNumber(int lineNumber);
 
+/*
+ * Method: indexOf
+ * Usage: int index = program.indexOf(lineNumber);
+ * -----------------------------------------------
+ * Returns the dense index the last link phase gave to the statement
+ * with the specified line number, or -1 if there is no such line.
+ */
+
+    int indexOf(int lineNumber);
+
+/*
+ * Method: reportMemory
+ * Usage: program.reportMemory(std::cerr);
+ * ---------------------------------------
+ * Writes how much memory the lines of the program occupy, split into
+ * the line store, the statement objects and the expression arena,
+ * both in total and per line.
+ */
+
+    void reportMemory(std::ostream &out);
+
+/*
+ * Method: reportPromotions
+ * Usage: program.reportPromotions(std::cerr);
+ * -------------------------------------------
+ * Writes the promotions the tiered engine has made so far, together
+ * with the lines the walker executed most often before each of them.
+ */
+
+    void reportPromotions(std::ostream &out);
+
+/*
+ * Method: reportCompiles
+ * Usage: program.reportCompiles(std::cerr);
+ * -----------------------------------------
+ * Writes how often RUN had to rebuild the compiled program, how many
+ * lines that compiled and how many it could take from the cache.
+ */
+
+    void reportCompiles(std::ostream &out);
+
+/*
+ * Method: reportHeap
+ * Usage: program.reportHeap(std::cerr);
+ * -------------------------------------
+ * Writes the heap statistics of the interpreter: the live and peak
+ * heap size, and for every MemoryCategory the memory its structures
+ * occupy now together with the allocations charged to it so far.
+ * The heap totals and allocation counts need enableMemoryAccounting.
+ */
+
+    void reportHeap(std::ostream &out);
+
+/*
+ * Method: reportProfile
+ * Usage: program.reportProfile(std::cerr);
+ * ----------------------------------------
+ * Writes the profile collected by the profiled runs so far: for every
+ * line that executed, its execution count, the time spent in it and
+ * its share of the total, most expensive first and annotated with the
+ * line's text.
+ */
+
+    void reportProfile(std::ostream &out);
+
+/*
+ * Method: compileStats
+ * Usage: const CompileStats &stats = program.compileStats();
+ * ----------------------------------------------------------
+ * Returns the counters behind reportCompiles.
+ */
+
+    const CompileStats &compileStats() const;
+
+/*
+ * Method: definedAt
+ * Usage: std::vector<std::string> names = program.definedAt(lineNumber);
+ * ----------------------------------------------------------------------
+ * Returns the variables that the definite-assignment analysis finds to
+ * be defined whenever the specified line starts executing, in slot
+ * order.  The program is compiled first if it has changed since the
+ * last compilation, whatever the engine, so the answer is always about
+ * the current lines; the analysis counts the variables defined at the
+ * time of that compilation as defined on entry.  The result is empty
+ * if the line does not exist or if the analysis was skipped because
+ * the program is too large, and holds every variable for a line that
+ * no path reaches.
+ */
+
+    std::vector<std::string> definedAt(int lineNumber);
+
+/*
+ * Method: assignment
+ * Usage: const DefiniteAssignment &analysis = program.assignment();
+ * ----------------------------------------------------------------
+ * Compiles the program if it has changed, like definedAt, and returns
+ * its definite-assignment analysis, which answers the same question
+ * for single instructions of the compiled image.
+ */
+
+    const DefiniteAssignment &assignment();
+
     void List();
 
     void Clear();
 
     void Run();
 
-    int line_now = -1;
-    bool end = false;
+/*
+ * Method: Profile
+ * Usage: program.Profile();
+ * -------------------------
+ * Discards the profile collected so far, runs the program once with
+ * profiling and writes the report of that run to the output.
+ */
+
+    void Profile();
+
+/*
+ * Method: MemStats
+ * Usage: program.MemStats();
+ * --------------------------
+ * Writes the report of reportHeap to the output.
+ */
+
+    void MemStats();
+
+    int pc = -1;
+    Engine engine = TIERED_ENGINE;
+
+/*
+ * Field: profiling
+ * ----------------
+ * When set, RUN executes the program on an instrumented tree walker
+ * that records the count and time of every line, whatever the engine.
+ * Runs without profiling do not pay for it.
+ */
+
+    bool profiling = false;
+
+/*
+ * Field: sampler
+ * --------------
+ * When set, RUN also uses the instrumented walker and the sampler
+ * records which line and subexpression every tick of CPU time lands
+ * in.  The samples of each run are collected as soon as it ends.
+ */
+
+    Sampler *sampler = nullptr;
+
+/*
+ * Field: tierThreshold
+ * --------------------
+ * The number of backward jumps to the same line after which the
+ * tiered engine promotes the running program.
+ */
+
+    int tierThreshold = 1000;
+
+/*
+ * Field: arena
+ * ------------
+ * Owns the expression nodes of every statement of the program.
+ */
+
+    ExpArena arena;
+
+/*
+ * Field: output
+ * -------------
+ * The sink for everything the interpreter prints.
+ */
 
-    void get_state(EvalState &state_in);
+    Output output;
 
 private:
 
-    std::map<int, std::string> list;
-    std::map<int, std::shared_ptr<Statement> > run;
+    LineStore lines;
     EvalState &state;
+    Bytecode image;
+    VM vm;
+    Jit jit;
+    DefiniteAssignment analysis;
+    CompileCache cache;
+    bool jitStale = true;
+    bool jitReady = false;
+    std::vector<int> numbers;
+    std::vector<Statement *> linked;
+    std::vector<int> relinks;                /* Lines replaced since the last link */
+    bool reshaped = true;                    /* Lines added or removed since then  */
+    int garbage = 0;
+    int runs = 0;
+    std::vector<long long> executions;
+    std::vector<int> backEdges;
+    std::vector<Promotion> promotions;
+    std::map<int, LineProfile> profile;     /* By line number */
+
+    void reclaim();
+
+    void link();
+
+    void walk();
+
+    void compile();
+
+    bool native();
+
+    void edited(int lineNumber, bool replaced);
+
+    void tiered();
+
+    void profiled();
+
+    void promote(int head, int from, long long steps, double milliseconds);
 };
 
 #endif
@@ -0,0 +1,130 @@
+/*
+ * File: sampler.cpp
+ * -----------------
+ * This file implements the Sampler class.
+ */
+
+#include <algorithm>
+#include <sys/time.h>
+#include "sampler.hpp"
+#include "program.hpp"
+
+/*
+ * Constant: BUFFER_WORDS
+ * ----------------------
+ * The size of the sample buffer.  At the default rate it holds minutes
+ * of deep samples; samples that do not fit are dropped and reported.
+ */
+
+static const size_t BUFFER_WORDS = size_t(1) << 22;
+
+Sampler *Sampler::active = nullptr;
+
+Sampler::Sampler(int hertz) : hertz(std::max(1, hertz)) {
+}
+
+Sampler::~Sampler() {
+    stop();
+}
+
+void Sampler::start() {
+    if (running) return;
+    buffer.resize(BUFFER_WORDS);
+    line = -1;
+    depth = 0;
+    active = this;
+    struct sigaction action = {};
+    action.sa_handler = handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, &previous);
+    itimerval timer = {};
+    timer.it_interval.tv_usec = std::max(1, 1000000 / hertz);
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    running = true;
+}
+
+void Sampler::stop() {
+    if (!running) return;
+    itimerval timer = {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    sigaction(SIGPROF, &previous, nullptr);
+    active = nullptr;
+    running = false;
+}
+
+/*
+ * Implementation notes: handler
+ * -----------------------------
+ * The handler only reads the shadow stack and writes into the buffer,
+ * which was allocated before the timer started, so it is safe to run
+ * at any point of the interpreter.  A sample whose stack is deeper
+ * than MAX_DEPTH keeps its outermost frames.
+ */
+
+void Sampler::handler(int) {
+    Sampler *sampler = active;
+    if (sampler == nullptr || sampler->line < 0) return;
+    std::atomic_signal_fence(std::memory_order_acquire);
+    int depth = std::min(int(sampler->depth), MAX_DEPTH);
+    if (depth < 0) depth = 0;
+    size_t used = sampler->used;
+    if (used + 2 + depth > sampler->buffer.size()) {
+        sampler->dropped++;
+        return;
+    }
+    int *out = sampler->buffer.data() + used;
+    out[0] = sampler->line;
+    out[1] = depth;
+    for (int i = 0; i < depth; i++) out[2 + i] = sampler->frames[i];
+    sampler->used = used + 2 + depth;
+}
+
+/*
+ * Implementation notes: collect
+ * -----------------------------
+ * Semicolons separate the frames of a folded stack, so any in a line's
+ * text are replaced by commas.  Labels are built once per distinct
+ * line and node.
+ */
+
+static std::string frameLabel(std::string text) {
+    std::replace(text.begin(), text.end(), ';', ',');
+    return text;
+}
+
+void Sampler::collect(Program &program) {
+    std::map<int, std::string> lineLabels, nodeLabels;
+    size_t used = this->used;
+    for (size_t at = 0; at < used;) {
+        int number = buffer[at], count = buffer[at + 1];
+        auto label = lineLabels.find(number);
+        if (label == lineLabels.end()) {
+            label = lineLabels.emplace(number, frameLabel(program.getSourceLine(number))).first;
+        }
+        std::string stack = label->second;
+        for (int i = 0; i < count; i++) {
+            int exp = buffer[at + 2 + i];
+            auto node = nodeLabels.find(exp);
+            if (node == nodeLabels.end()) {
+                node = nodeLabels.emplace(exp, frameLabel(program.arena.toString(exp))).first;
+            }
+            stack += ';';
+            stack += node->second;
+        }
+        stacks[stack]++;
+        at += 2 + count;
+    }
+    this->used = 0;
+    if (dropped > 0) {
+        stacks["(dropped)"] += dropped;
+        dropped = 0;
+    }
+}
+
+void Sampler::write(std::ostream &out) const {
+    for (const auto &entry: stacks) {
+        out << entry.first << ' ' << entry.second << '\n';
+    }
+}
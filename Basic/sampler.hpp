@@ -0,0 +1,138 @@
+/*
+ * File: sampler.hpp
+ * -----------------
+ * This interface exports the Sampler class, a statistical profiler
+ * that records which line and which subexpression the tree walker is
+ * evaluating whenever a CPU-time timer fires, and writes the result as
+ * folded stacks for flame graph tools.
+ */
+
+#ifndef _sampler_h
+#define _sampler_h
+
+#include <atomic>
+#include <csignal>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Program;
+
+/*
+ * Class: Sampler
+ * --------------
+ * While a sampled RUN is in progress, the walker reports the line it
+ * executes and ExpArena reports every node it enters and leaves.  The
+ * sampler keeps these on a shadow stack, which a SIGPROF handler
+ * copies into a preallocated buffer on every tick.  After the run the
+ * samples are turned into stacks of labels, a line's text followed by
+ * the expressions from the root down to the node being evaluated,
+ * which are counted across runs.
+ */
+
+class Sampler {
+
+public:
+
+/*
+ * Constructor: Sampler
+ * Usage: Sampler sampler(hertz);
+ * ------------------------------
+ * Creates a sampler that takes the specified number of samples per
+ * second of CPU time while it is running.
+ */
+
+    explicit Sampler(int hertz = 1000);
+
+    Sampler(const Sampler &) = delete;
+
+    Sampler &operator=(const Sampler &) = delete;
+
+    ~Sampler();
+
+/*
+ * Methods: start, stop
+ * Usage: sampler.start();
+ *        sampler.stop();
+ * -----------------------
+ * Install the signal handler and the timer, and remove them again.
+ * Only one sampler can run at a time.
+ */
+
+    void start();
+
+    void stop();
+
+/*
+ * Methods: enter, push, pop
+ * Usage: sampler.enter(lineNumber);
+ *        sampler.push(exp);
+ *        sampler.pop();
+ * --------------------------------
+ * Maintain the shadow stack: enter starts a new line with an empty
+ * stack, and push and pop bracket the evaluation of a node.  Nodes
+ * nested deeper than MAX_DEPTH are counted but not recorded.
+ */
+
+    void enter(int lineNumber) {
+        line = lineNumber;
+        depth = 0;
+    }
+
+    void push(int exp) {
+        int d = depth;
+        if (d < MAX_DEPTH) frames[d] = exp;
+        std::atomic_signal_fence(std::memory_order_release);
+        depth = d + 1;
+    }
+
+    void pop() {
+        depth = depth - 1;
+    }
+
+/*
+ * Method: collect
+ * Usage: sampler.collect(program);
+ * --------------------------------
+ * Labels the samples taken since the last call with the text of their
+ * lines and the expressions of their nodes in the program, adds them
+ * to the stack counts and empties the buffer.  This must happen before
+ * the program is edited, which may move the nodes, and while the
+ * sampler is stopped.
+ */
+
+    void collect(Program &program);
+
+/*
+ * Method: write
+ * Usage: sampler.write(out);
+ * --------------------------
+ * Writes the stack counts in the folded format, one stack per line
+ * with its frames separated by semicolons and followed by its count.
+ */
+
+    void write(std::ostream &out) const;
+
+    static constexpr int MAX_DEPTH = 128;
+
+private:
+
+    int hertz;
+    volatile int line = -1;
+    volatile int depth = 0;
+    int frames[MAX_DEPTH];
+    std::vector<int> buffer;                /* line, depth, frames... per sample */
+    volatile size_t used = 0;
+    long long dropped = 0;
+    std::map<std::string, long long> stacks;
+    struct sigaction previous;
+    bool running = false;
+
+    static Sampler *active;
+
+    static void handler(int signal);
+
+};
+
+#endif
@@ -1,110 +1,379 @@
 /*
  * File: statement.cpp
  * -------------------
- * This file implements the constructor and destructor for
- * the Statement class itself.  Your implementation must do
- * the same for the subclasses you define for each of the
- * BASIC statements.
+ * This file implements the Statement class and its subclasses for
+ * the BASIC statements, together with saving statements to records
+ * and restoring them.
  */
 
+#include "memstats.hpp"
 #include "statement.hpp"
 
 
 /* Implementation of the Statement class */
 
-int stringToInt(std::string str);
-
 Statement::Statement() = default;
 
 Statement::~Statement() = default;
 
-void Rem::execute(EvalState &state, Program &program) {
-    program.line_now = program.getNextLineNumber(program.line_now);
+void Statement::link(Program &) {
+}
+
+void Statement::relocate(int delta) {
+    expBegin += delta;
+    expEnd += delta;
+}
+
+void Statement::rebind(const std::vector<int> &) {
+}
+
+void Rem::execute(EvalState &, Program &program) {
+    program.pc = next;
 }
 
 
 void Let::execute(EvalState &state, Program &program) {
-    program.line_now = program.getNextLineNumber(program.line_now);
-    state.setValue(var.name, val->eval(state));
+    state.setValue(var, program.arena.eval(val, state));
+    program.pc = next;
 }
 
 
 void Print::execute(EvalState &state, Program &program) {
-    std::cout << var->eval(state) << std::endl;
-    program.line_now = program.getNextLineNumber(program.line_now);
+    program.output.print(program.arena.eval(var, state));
+    program.pc = next;
 }
 
 
 void Input::execute(EvalState &state, Program &program) {
+    state.setValue(var, readValue(program.output));
+    program.pc = next;
+}
+
+int Input::readValue(Output &output) {
     while (true) {
-        std::cout << " ? ";
+        output.write(" ? ");
+        output.flush();
         std::string tem;
         getline(std::cin, tem);
-        TokenScanner t;
-        t.ignoreWhitespace();
-        t.scanNumbers();
-        t.setInput(tem);
-        std::string first = t.nextToken();
+        Lexer t(tem);
+        Token first = t.nextToken();
         if (first != "-") {
             if (t.hasMoreTokens()) {
-                std::cout << ("INVALID NUMBER\n");
+                output.write("INVALID NUMBER\n");
                 continue;
             }
-            if (t.getTokenType(first) != NUMBER) {
-                std::cout << ("INVALID NUMBER\n");
+            if (first.type != NUMBER) {
+                output.write("INVALID NUMBER\n");
                 continue;
             }
-            if (first.find('.') < first.size()) {
-                std::cout << ("INVALID NUMBER\n");
+            if (first.text.find('.') != std::string_view::npos) {
+                output.write("INVALID NUMBER\n");
                 continue;
             }
-            state.setValue(var.toString(), stringToInteger(tem));
+            return tokenToInteger(tem);
         } else {
             if (!t.hasMoreTokens()) {
-                std::cout << ("INVALID NUMBER\n");
+                output.write("INVALID NUMBER\n");
                 continue;
             }
-            std::string second = t.nextToken();
+            Token second = t.nextToken();
             if (t.hasMoreTokens()) {
-                std::cout << ("INVALID NUMBER\n");
+                output.write("INVALID NUMBER\n");
                 continue;
             }
-            if (t.getTokenType(second) != NUMBER) {
-                std::cout << ("INVALID NUMBER\n");
+            if (second.type != NUMBER) {
+                output.write("INVALID NUMBER\n");
                 continue;
             }
-            if (second.find('.') < second.size()) {
-                std::cout << ("INVALID NUMBER\n");
+            if (second.text.find('.') != std::string_view::npos) {
+                output.write("INVALID NUMBER\n");
                 continue;
             }
-            state.setValue(var.toString(), -stringToInteger(second));
+            return -tokenToInteger(second.text);
         }
-        program.line_now = program.getNextLineNumber(program.line_now);
-        break;
     }
 }
 
 
-void End::execute(EvalState &state, Program &program) {
-    program.end = true;
+void End::execute(EvalState &, Program &program) {
+    program.pc = -1;
 }
 
 
-void Goto::execute(EvalState &state, Program &program) {
-    program.line_now = line;
+void Goto::execute(EvalState &, Program &program) {
+    if (target < 0) error("LINE NUMBER ERROR");
+    program.pc = target;
+}
+
+void Goto::link(Program &program) {
+    target = program.indexOf(line);
 }
 
 
 void If::execute(EvalState &state, Program &program) {
     int left, right;
-    TokenScanner t;
-    left = lhs->eval(state);
-    right = rhs->eval(state);
+    left = program.arena.eval(lhs, state);
+    right = program.arena.eval(rhs, state);
     bool cmp = false;
-    if ((op == "=" && left == right) || (op == "<" && left < right) || (op == ">" && left > right))cmp = true;
+    switch (op) {
+        case '=':
+            cmp = left == right;
+            break;
+        case '<':
+            cmp = left < right;
+            break;
+        case '>':
+            cmp = left > right;
+            break;
+    }
     if (cmp) {
-        program.line_now = line_number;
+        if (target < 0) error("LINE NUMBER ERROR");
+        program.pc = target;
     } else {
-        program.line_now = program.getNextLineNumber(program.line_now);
+        program.pc = next;
+    }
+}
+
+void If::link(Program &program) {
+    target = program.indexOf(line_number);
+}
+
+
+/*
+ * Implementation notes: compile
+ * -----------------------------
+ * Each statement emits the instructions that mirror its execute
+ * method.  Control transfers name BASIC line numbers, which the
+ * compiler resolves to instruction indices once the whole program
+ * has been emitted; falling through to the next line needs no
+ * instruction at all.
+ */
+
+void Rem::compile(Compiler &) {
+}
+
+void Let::compile(Compiler &compiler) {
+    compiler.expression(val);
+    compiler.emit(OP_STORE, var);
+}
+
+void Print::compile(Compiler &compiler) {
+    compiler.expression(var);
+    compiler.emit(OP_PRINT);
+}
+
+void Input::compile(Compiler &compiler) {
+    compiler.emit(OP_INPUT, var);
+}
+
+void End::compile(Compiler &compiler) {
+    compiler.emit(OP_END);
+}
+
+void Goto::compile(Compiler &compiler) {
+    compiler.emitJump(OP_JUMP, line);
+}
+
+void If::compile(Compiler &compiler) {
+    compiler.expression(lhs);
+    compiler.expression(rhs);
+    if (op == '=') compiler.emitJump(OP_JUMP_EQ, line_number);
+    else if (op == '<') compiler.emitJump(OP_JUMP_LT, line_number);
+    else compiler.emitJump(OP_JUMP_GT, line_number);
+}
+
+void Let::relocate(int delta) {
+    Statement::relocate(delta);
+    val += delta;
+}
+
+void Let::rebind(const std::vector<int> &slots) {
+    var = slots[var];
+}
+
+void Input::rebind(const std::vector<int> &slots) {
+    var = slots[var];
+}
+
+void Print::relocate(int delta) {
+    Statement::relocate(delta);
+    var += delta;
+}
+
+void If::relocate(int delta) {
+    Statement::relocate(delta);
+    lhs += delta;
+    rhs += delta;
+}
+
+size_t Rem::footprint() const {
+    return sizeof(*this);
+}
+
+size_t Let::footprint() const {
+    return sizeof(*this);
+}
+
+size_t Print::footprint() const {
+    return sizeof(*this);
+}
+
+size_t Input::footprint() const {
+    return sizeof(*this);
+}
+
+size_t End::footprint() const {
+    return sizeof(*this);
+}
+
+size_t Goto::footprint() const {
+    return sizeof(*this);
+}
+
+size_t If::footprint() const {
+    return sizeof(*this);
+}
+
+/*
+ * Implementation notes: save
+ * --------------------------
+ * Every record starts from the node range of the statement, and the
+ * unused fields stay zero so that equal statements give equal bytes.
+ */
+
+static StatementRecord recordOf(const Statement &statement, commands kind) {
+    StatementRecord record{};
+    record.kind = kind;
+    record.expBegin = statement.expBegin;
+    record.expEnd = statement.expEnd;
+    return record;
+}
+
+StatementRecord Rem::save() const {
+    return recordOf(*this, REM);
+}
+
+StatementRecord Let::save() const {
+    StatementRecord record = recordOf(*this, LET);
+    record.fields[0] = var;
+    record.fields[1] = val;
+    return record;
+}
+
+StatementRecord Print::save() const {
+    StatementRecord record = recordOf(*this, PRINT);
+    record.fields[0] = var;
+    return record;
+}
+
+StatementRecord Input::save() const {
+    StatementRecord record = recordOf(*this, INPUT);
+    record.fields[0] = var;
+    return record;
+}
+
+StatementRecord End::save() const {
+    return recordOf(*this, END);
+}
+
+StatementRecord Goto::save() const {
+    StatementRecord record = recordOf(*this, GOTO);
+    record.fields[0] = line;
+    return record;
+}
+
+StatementRecord If::save() const {
+    StatementRecord record = recordOf(*this, IF);
+    record.fields[0] = lhs;
+    record.fields[1] = rhs;
+    record.fields[2] = op;
+    record.fields[3] = line_number;
+    return record;
+}
+
+std::shared_ptr<Statement> restoreStatement(const StatementRecord &record) {
+    MemoryScope scope(MEMORY_STATEMENTS);
+    std::shared_ptr<Statement> result;
+    switch (record.kind) {
+        case REM:
+            result = std::make_shared<Rem>();
+            break;
+        case LET: {
+            std::shared_ptr<Let> stmt = std::make_shared<Let>();
+            stmt->var = record.fields[0];
+            stmt->val = record.fields[1];
+            result = stmt;
+            break;
+        }
+        case PRINT: {
+            std::shared_ptr<Print> stmt = std::make_shared<Print>();
+            stmt->var = record.fields[0];
+            result = stmt;
+            break;
+        }
+        case INPUT: {
+            std::shared_ptr<Input> stmt = std::make_shared<Input>();
+            stmt->var = record.fields[0];
+            result = stmt;
+            break;
+        }
+        case END:
+            result = std::make_shared<End>();
+            break;
+        case GOTO: {
+            std::shared_ptr<Goto> stmt = std::make_shared<Goto>();
+            stmt->line = record.fields[0];
+            result = stmt;
+            break;
+        }
+        case IF: {
+            std::shared_ptr<If> stmt = std::make_shared<If>();
+            stmt->lhs = record.fields[0];
+            stmt->rhs = record.fields[1];
+            stmt->op = char(record.fields[2]);
+            stmt->line_number = record.fields[3];
+            result = stmt;
+            break;
+        }
+        default:
+            error("Unknown statement kind");
+    }
+    result->expBegin = record.expBegin;
+    result->expEnd = record.expEnd;
+    return result;
+}
+
+/*
+ * Implementation notes: wellFormed
+ * --------------------------------
+ * The node fields must point into the statement's own range, since
+ * relocating the statement moves only that range, and the variable
+ * fields must be valid indices into the slots it is rebound with.
+ */
+
+bool wellFormed(const StatementRecord &record, int names, int nodes) {
+    if (record.expBegin < 0 || record.expBegin > record.expEnd || record.expEnd > nodes) return false;
+    auto node = [&](int exp) {
+        return exp >= record.expBegin && exp < record.expEnd;
+    };
+    auto name = [&](int slot) {
+        return slot >= 0 && slot < names;
+    };
+    switch (record.kind) {
+        case REM:
+        case END:
+        case GOTO:
+            return true;
+        case LET:
+            return name(record.fields[0]) && node(record.fields[1]);
+        case PRINT:
+            return node(record.fields[0]);
+        case INPUT:
+            return name(record.fields[0]);
+        case IF:
+            return node(record.fields[0]) && node(record.fields[1]) &&
+                   (record.fields[2] == '=' || record.fields[2] == '<' || record.fields[2] == '>');
+        default:
+            return false;
     }
 }
@@ -12,19 +12,36 @@
 #ifndef _statement_h
 #define _statement_h
 
+#include <cstdint>
 #include <string>
 #include <sstream>
 #include "evalstate.hpp"
 #include "exp.hpp"
-#include "Utils/tokenScanner.hpp"
+#include "Utils/lexer.hpp"
 #include "program.hpp"
 #include"parser.hpp"
 #include "Utils/error.hpp"
 #include "Utils/strlib.hpp"
+#include "vm.hpp"
+#include "output.hpp"
 #include <string>
 
 class Program;
 
+/*
+ * Type: StatementRecord
+ * ---------------------
+ * A flat copy of a statement that holds no pointers, in which compiled
+ * programs are stored on disk.  kind is the command the statement was
+ * parsed from, and the meaning of the fields depends on it.
+ */
+
+struct StatementRecord {
+    int32_t kind;
+    int32_t expBegin, expEnd;
+    int32_t fields[4];
+};
+
 /*
  * Class: Statement
  * ----------------
@@ -72,64 +89,239 @@ public:
 
     virtual void execute(EvalState &state, Program &program) = 0;
 
+/*
+ * Method: compile
+ * Usage: stmt->compile(compiler);
+ * -------------------------------
+ * Emits the bytecode for this statement.  The instructions must have
+ * the same effect on the EvalState as a call to execute, including
+ * the errors that execute would report.
+ */
+
+    virtual void compile(Compiler &compiler) = 0;
+
+/*
+ * Method: link
+ * Usage: stmt->link(program);
+ * ---------------------------
+ * Resolves the line numbers this statement refers to into dense
+ * statement indices of the program.  Statements without jump
+ * targets need no linking, which is what the default does.
+ */
+
+    virtual void link(Program &program);
+
+/*
+ * Method: relocate
+ * Usage: stmt->relocate(delta);
+ * -----------------------------
+ * Called when Program compacts its expression arena and the nodes of
+ * this statement move by delta positions.  Statements holding
+ * expressions must shift their root indices; the default shifts only
+ * the recorded node range.
+ */
+
+    virtual void relocate(int delta);
+
+/*
+ * Method: rebind
+ * Usage: stmt->rebind(slots);
+ * ---------------------------
+ * Called when the statement was parsed against another EvalState and
+ * is moved into the program.  Statements holding variable slots must
+ * replace each slot s by slots[s]; the default does nothing.
+ */
+
+    virtual void rebind(const std::vector<int> &slots);
+
+/*
+ * Method: footprint
+ * Usage: size_t bytes = stmt->footprint();
+ * ----------------------------------------
+ * Returns the size of the statement object itself, for the memory
+ * statistics.  Its expression nodes live in the arena and are not
+ * included.
+ */
+
+    virtual size_t footprint() const = 0;
+
+/*
+ * Method: save
+ * Usage: StatementRecord record = stmt->save();
+ * ---------------------------------------------
+ * Returns a record from which restoreStatement rebuilds an equal
+ * statement.  Links to other statements are not saved.
+ */
+
+    virtual StatementRecord save() const = 0;
+
+/*
+ * Field: next
+ * -----------
+ * The index of the statement that follows this one in the linked
+ * program, or -1 if it is the last one.
+ */
+
+    int next = -1;
+
+/*
+ * Fields: expBegin, expEnd
+ * ------------------------
+ * The range of arena nodes that belong to this statement.
+ */
+
+    int expBegin = 0, expEnd = 0;
+
 };
 
 class Rem : public Statement {
     void execute(EvalState &state, Program &program) override;
+
+    void compile(Compiler &compiler) override;
+
+    size_t footprint() const override;
+
+    StatementRecord save() const override;
 };
 
 class Let : public Statement {
 public:
     void execute(EvalState &state, Program &program) override;
 
-    IdentifierExp var;
-    std::shared_ptr<Expression> val;
+    void compile(Compiler &compiler) override;
+
+    size_t footprint() const override;
+
+    StatementRecord save() const override;
+
+    void relocate(int delta) override;
+
+    void rebind(const std::vector<int> &slots) override;
+
+    int var = -1;       /* Slot of the assigned variable */
+    int val = -1;       /* Root of the value expression  */
 };
 
 class Print : public Statement {
 public:
     void execute(EvalState &state, Program &program) override;
 
-    std::shared_ptr<Expression> var;
+    void compile(Compiler &compiler) override;
+
+    size_t footprint() const override;
+
+    StatementRecord save() const override;
+
+    void relocate(int delta) override;
+
+    int var = -1;       /* Root of the printed expression */
 };
 
 class Input : public Statement {
 public:
     void execute(EvalState &state, Program &program) override;
 
-    IdentifierExp var;
+    void compile(Compiler &compiler) override;
+
+    size_t footprint() const override;
+
+    StatementRecord save() const override;
+
+/*
+ * Method: readValue
+ * Usage: int value = Input::readValue(output);
+ * --------------------------------------------
+ * Prompts for an integer on the console until a valid one is entered
+ * and returns it.  The output is flushed before every prompt.
+ */
+
+    static int readValue(Output &output);
+
+    void rebind(const std::vector<int> &slots) override;
+
+    int var = -1;       /* Slot of the variable read */
 };
 
 class End : public Statement {
 public:
     void execute(EvalState &state, Program &program) override;
+
+    void compile(Compiler &compiler) override;
+
+    size_t footprint() const override;
+
+    StatementRecord save() const override;
 };
 
 class Goto : public Statement {
 public:
     void execute(EvalState &state, Program &program) override;
 
+    void compile(Compiler &compiler) override;
+
+    size_t footprint() const override;
+
+    StatementRecord save() const override;
+
+    void link(Program &program) override;
+
     int line = 0;
+    int target = -1;
 };
 
 class If : public Statement {
 public:
     void execute(EvalState &state, Program &program) override;
 
-    std::shared_ptr<Expression> lhs, rhs;
-    std::string op;
+    void compile(Compiler &compiler) override;
+
+    size_t footprint() const override;
+
+    StatementRecord save() const override;
+
+    void link(Program &program) override;
+
+    void relocate(int delta) override;
+
+    int lhs = -1, rhs = -1;
+    char op = '=';
     int line_number = 0;
+    int target = -1;
 };
 
+/*
+ * Function: restoreStatement
+ * Usage: std::shared_ptr<Statement> stmt = restoreStatement(record);
+ * ------------------------------------------------------------------
+ * Rebuilds a statement from the record returned by its save method.
+ * Its expression nodes and variable slots are those of the arena and
+ * EvalState it was saved from, so callers that load it elsewhere must
+ * relocate and rebind it.  A record of an unknown kind raises an error.
+ */
+
+std::shared_ptr<Statement> restoreStatement(const StatementRecord &record);
+
+/*
+ * Function: wellFormed
+ * Usage: if (wellFormed(record, names, nodes)) ...
+ * ------------------------------------------------
+ * Returns true if the record is of a known kind, its node range lies
+ * within the first nodes nodes, its expressions are rooted inside that
+ * range and its variables are among the first names slots, so that a
+ * record read from disk can be restored, relocated and rebound without
+ * indexing outside the image it came from.
+ */
+
+bool wellFormed(const StatementRecord &record, int names, int nodes);
+
 /*
  * The remainder of this file must consists of subclass
  * definitions for the individual statement forms.  Each of
  * those subclasses must define a constructor that parses a
  * statement from a scanner and a method called execute,
- * which executes that statement.  If the private data for
- * a subclass includes data allocated on the heap (such as
- * an Expression object), the class implementation must also
- * specify its own destructor method to free that memory.
+ * which executes that statement.  Expressions are not owned by
+ * the statements: they live in the ExpArena of the Program and
+ * statements refer to them by the index of their root node.
  */
 
 #endif
@@ -0,0 +1,665 @@
+/*
+ * File: vm.cpp
+ * ------------
+ * This file implements the bytecode compiler and the virtual machine
+ * declared in vm.hpp.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <set>
+#include "vm.hpp"
+#include "statement.hpp"
+
+/*
+ * Implementation notes: stack effects
+ * -----------------------------------
+ * The compiler tracks the depth of the value stack while emitting
+ * instructions so that the VM can allocate the stack once per run.
+ */
+
+static int stackEffect(OpCode op) {
+    switch (op) {
+        case OP_CONST:
+        case OP_LOAD:
+            return 1;
+        case OP_STORE:
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+        case OP_PRINT:
+            return -1;
+        case OP_JUMP_EQ:
+        case OP_JUMP_LT:
+        case OP_JUMP_GT:
+            return -2;
+        default:
+            return 0;
+    }
+}
+
+void Bytecode::clear() {
+    code.clear();
+    lines.clear();
+    messages.clear();
+    starts.clear();
+    numbers.clear();
+    loops.clear();
+    maxDepth = 0;
+}
+
+/* Implementation of the Compiler class */
+
+Compiler::Compiler(Bytecode &image, const ExpArena &arena) : image(image), arena(arena) {}
+
+void Compiler::compile(LineStore &lines) {
+    image.clear();
+    for (const SourceLine &entry: lines) {
+        add(entry);
+    }
+    link();
+}
+
+void Compiler::add(const SourceLine &entry) {
+    line = entry.number;
+    image.numbers.push_back(line);
+    image.starts.push_back(int(image.code.size()));
+    entry.statement->compile(*this);
+    depth = 0;
+}
+
+/*
+ * Implementation notes: link
+ * --------------------------
+ * Until the image is linked, the argument of every jump is the line
+ * number it goes to, which is looked up in the sorted line numbers of
+ * the image.
+ */
+
+void Compiler::link() {
+    line = image.numbers.empty() ? -1 : image.numbers.back();
+    int size = int(image.code.size());
+    emit(OP_END);
+    int missing = -1;
+    for (int pc = 0; pc < size; pc++) {
+        Instruction &ins = image.code[pc];
+        if (ins.op != OP_JUMP && ins.op != OP_JUMP_EQ && ins.op != OP_JUMP_LT && ins.op != OP_JUMP_GT) continue;
+        auto target = std::lower_bound(image.numbers.begin(), image.numbers.end(), ins.arg);
+        if (target != image.numbers.end() && *target == ins.arg) {
+            ins.arg = image.starts[target - image.numbers.begin()];
+            continue;
+        }
+        if (missing == -1) {
+            missing = int(image.code.size());
+            emitFail("LINE NUMBER ERROR");
+        }
+        image.code[pc].arg = missing;
+    }
+    closeLoops();
+    fuse();
+}
+
+/*
+ * Implementation notes: closeLoops
+ * --------------------------------
+ * A counting loop shows up in the bytecode as a conditional jump back
+ * to the start of a line, preceded by the two operands of its test
+ * and by nothing but the four instruction groups of simple LETs.
+ * Every loop that analyze accepts gets an OP_CLOSED_LOOP in front of
+ * its head, which takes the place of the head for the jumps from
+ * elsewhere, for falling through from the previous line and for the
+ * tiered engine.  Only the jump that closes the loop still goes to the
+ * body itself, so that a loop that has to run step by step evaluates
+ * the precondition once rather than in every iteration.
+ */
+
+void Compiler::closeLoops() {
+    std::vector<Instruction> &code = image.code;
+    int size = int(code.size());
+    std::vector<int> loopAt(size, -1);
+    std::vector<int> jumps;                     /* The closing jump of every loop */
+    for (int pc = 0; pc < size; pc++) {
+        const Instruction &ins = code[pc];
+        if ((ins.op != OP_JUMP_LT && ins.op != OP_JUMP_GT) || ins.arg > pc - 2) continue;
+        ClosedLoop loop;
+        if (loopAt[ins.arg] >= 0 || !analyze(ins.arg, pc, loop)) continue;
+        loop.exit = pc + 1;
+        loopAt[ins.arg] = int(image.loops.size());
+        image.loops.push_back(loop);
+        jumps.push_back(pc);
+    }
+    if (image.loops.empty()) return;
+
+    std::vector<int> moved(size);
+    std::vector<Instruction> closed;
+    std::vector<int> lines;
+    for (int pc = 0; pc < size; pc++) {
+        if (loopAt[pc] >= 0) {
+            closed.push_back({OP_CLOSED_LOOP, loopAt[pc]});
+            lines.push_back(image.lines[pc]);
+        }
+        moved[pc] = int(closed.size());
+        closed.push_back(code[pc]);
+        lines.push_back(image.lines[pc]);
+    }
+    auto entry = [&](int pc) {
+        return loopAt[pc] >= 0 ? moved[pc] - 1 : moved[pc];
+    };
+    for (Instruction &ins: closed) {
+        if (ins.op == OP_JUMP || ins.op == OP_JUMP_EQ || ins.op == OP_JUMP_LT || ins.op == OP_JUMP_GT) {
+            ins.arg = entry(ins.arg);
+        }
+    }
+    for (int jump: jumps) {
+        closed[moved[jump]].arg = moved[code[jump].arg];
+    }
+    for (ClosedLoop &loop: image.loops) {
+        loop.exit = entry(loop.exit);
+    }
+    for (int &start: image.starts) {
+        start = entry(start);
+    }
+    code.swap(closed);
+    image.lines.swap(lines);
+}
+
+/*
+ * Implementation notes: analyze
+ * -----------------------------
+ * Every LET of the body must have the form V = V + X, V = V - X or
+ * V = X + V, and assign a variable no other LET assigns.  V is an
+ * induction variable if X is a constant or a variable the body does
+ * not assign, and an accumulator if X is an induction variable.  The
+ * test must compare an induction variable with a constant or with a
+ * variable the body does not assign, using < or >.
+ */
+
+bool Compiler::analyze(int head, int jump, ClosedLoop &loop) {
+    const std::vector<Instruction> &code = image.code;
+    int test = jump - 2;
+    if (head >= test || (test - head) % 4 != 0) return false;
+
+    struct Update {
+        int slot;
+        Instruction operand;
+        bool negative;
+    };
+    std::vector<Update> updates;
+    std::set<int> written;
+    for (int pc = head; pc < test; pc += 4) {
+        const Instruction *group = &code[pc];
+        if (group[3].op != OP_STORE || (group[2].op != OP_ADD && group[2].op != OP_SUB)) return false;
+        int slot = group[3].arg;
+        Update update{slot, group[1], group[2].op == OP_SUB};
+        if (group[0].op == OP_LOAD && group[0].arg == slot) {
+            update.operand = group[1];
+        } else if (group[2].op == OP_ADD && group[1].op == OP_LOAD && group[1].arg == slot) {
+            update.operand = group[0];
+        } else {
+            return false;
+        }
+        if (update.operand.op != OP_LOAD && update.operand.op != OP_CONST) return false;
+        if (!written.insert(slot).second) return false;
+        updates.push_back(update);
+    }
+
+    auto invariant = [&](const Instruction &ins) {
+        return ins.op == OP_CONST || (ins.op == OP_LOAD && written.count(ins.arg) == 0);
+    };
+    std::vector<int> induction(updates.size(), -1);
+    for (size_t i = 0; i < updates.size(); i++) {
+        const Update &update = updates[i];
+        if (!invariant(update.operand)) continue;
+        induction[i] = int(loop.inductions.size());
+        loop.inductions.push_back({update.slot, update.operand.arg, update.operand.op == OP_CONST, update.negative});
+    }
+    for (size_t i = 0; i < updates.size(); i++) {
+        const Update &update = updates[i];
+        if (induction[i] >= 0) continue;
+        auto source = std::find_if(updates.begin(), updates.end(), [&](const Update &other) {
+            return other.slot == update.operand.arg;
+        });
+        int index = int(source - updates.begin());
+        if (induction[index] < 0) return false;
+        loop.accumulators.push_back({update.slot, induction[index], update.negative, index < int(i)});
+    }
+
+    Instruction lhs = code[test], rhs = code[test + 1];
+    loop.test = code[jump].op;
+    if (invariant(lhs)) {
+        std::swap(lhs, rhs);
+        loop.test = loop.test == OP_JUMP_LT ? OP_JUMP_GT : OP_JUMP_LT;
+    }
+    if (lhs.op != OP_LOAD || !invariant(rhs)) return false;
+    auto counter = std::find_if(loop.inductions.begin(), loop.inductions.end(), [&](const Induction &v) {
+        return v.slot == lhs.arg;
+    });
+    if (counter == loop.inductions.end()) return false;
+    loop.counter = int(counter - loop.inductions.begin());
+    loop.bound = rhs.arg;
+    loop.constantBound = rhs.op == OP_CONST;
+
+    for (const Update &update: updates) {
+        loop.reads.push_back(update.slot);
+        if (update.operand.op == OP_LOAD) loop.reads.push_back(update.operand.arg);
+    }
+    if (!loop.constantBound) loop.reads.push_back(loop.bound);
+    return true;
+}
+
+/*
+ * Implementation notes: fuse
+ * --------------------------
+ * The peephole pass tries the sequences listed in vm.hpp, longest
+ * first, at every OP_LOAD and rewrites the OP_LOAD of a match into the
+ * superinstruction.  A sequence is fused only if no jump lands inside
+ * it, so that every jump still arrives at the beginning of one.  It may
+ * however extend across a line boundary, which is what lets the LET
+ * that steps a loop counter and the IF that tests it run as one
+ * instruction.
+ */
+
+static bool isJump(OpCode op) {
+    return op == OP_JUMP_EQ || op == OP_JUMP_LT || op == OP_JUMP_GT;
+}
+
+void Compiler::fuse() {
+    std::vector<Instruction> &code = image.code;
+    int size = int(code.size());
+    std::vector<char> target(size, 0);
+    for (const Instruction &ins: code) {
+        if (ins.op == OP_JUMP || isJump(ins.op)) target[ins.arg] = 1;
+    }
+    for (const ClosedLoop &loop: image.loops) {
+        target[loop.exit] = 1;
+    }
+    auto is = [&](int pc, OpCode op) {
+        return pc < size && code[pc].op == op;
+    };
+    auto operand = [&](int pc) {
+        return is(pc, OP_LOAD) || is(pc, OP_CONST);
+    };
+    auto straight = [&](int pc, int length) {
+        if (pc + length > size) return false;
+        for (int i = pc + 1; i < pc + length; i++) {
+            if (target[i]) return false;
+        }
+        return true;
+    };
+    for (int pc = 0; pc < size; pc++) {
+        if (code[pc].op != OP_LOAD) continue;
+        bool constant = is(pc + 1, OP_CONST);
+        if (constant && (is(pc + 2, OP_ADD) || is(pc + 2, OP_SUB)) && is(pc + 3, OP_STORE)
+            && is(pc + 4, OP_LOAD) && code[pc + 4].arg == code[pc + 3].arg
+            && operand(pc + 5) && pc + 6 < size && isJump(code[pc + 6].op) && straight(pc, 7)) {
+            code[pc].op = OpCode(OP_STEP_JUMP_EQ + (code[pc + 6].op - OP_JUMP_EQ));
+            pc += 6;
+        } else if (constant && (is(pc + 2, OP_ADD) || is(pc + 2, OP_SUB) || is(pc + 2, OP_MUL))
+                   && is(pc + 3, OP_STORE) && straight(pc, 4)) {
+            code[pc].op = OpCode(OP_ADD_CONST + (code[pc + 2].op - OP_ADD));
+            pc += 3;
+        } else if (operand(pc + 1) && pc + 2 < size && isJump(code[pc + 2].op) && straight(pc, 3)) {
+            code[pc].op = OpCode(OP_JUMP_EQ_VAR + (code[pc + 2].op - OP_JUMP_EQ));
+            pc += 2;
+        }
+    }
+}
+
+void Compiler::emit(OpCode op, int arg) {
+    image.code.push_back({op, arg});
+    image.lines.push_back(line);
+    depth += stackEffect(op);
+    if (depth > image.maxDepth) image.maxDepth = depth;
+}
+
+void Compiler::emitJump(OpCode op, int lineNumber) {
+    emit(op, lineNumber);
+}
+
+void Compiler::expression(int exp) {
+    arena.compile(exp, *this);
+}
+
+/*
+ * Implementation notes: emitFail
+ * ------------------------------
+ * The messages are interned, since the few that can occur are emitted
+ * again on every recompile of a line that fails.
+ */
+
+void Compiler::emitFail(const std::string &message) {
+    auto found = std::find(image.messages.begin(), image.messages.end(), message);
+    if (found == image.messages.end()) found = image.messages.insert(found, message);
+    emit(OP_FAIL, int(found - image.messages.begin()));
+}
+
+/* Implementation of the CompileCache class */
+
+void CompileCache::invalidate(int lineNumber) {
+    dirty.push_back(lineNumber);
+}
+
+void CompileCache::clear() {
+    raw.clear();
+    dirty.clear();
+    valid = false;
+}
+
+/*
+ * Implementation notes: update
+ * ----------------------------
+ * The new unlinked image is assembled in line order, walking the
+ * cached lines and the sorted dirty numbers alongside.  The code of a
+ * line that is cached and not dirty is copied, every other line is
+ * compiled.  Copying keeps the OP_FAIL message numbers valid because
+ * the message table is carried over and only ever appended to, which
+ * emitFail does once per distinct message; it is reset with the rest
+ * of the cache by clear.  The linked image is a
+ * copy of the result, since linking resolves the jumps.
+ */
+
+bool CompileCache::update(LineStore &lines, const ExpArena &arena, Bytecode &image) {
+    if (valid && dirty.empty()) {
+        counts.hits++;
+        return false;
+    }
+    std::sort(dirty.begin(), dirty.end());
+    Bytecode fresh;
+    fresh.messages = std::move(raw.messages);
+    fresh.maxDepth = raw.maxDepth;
+    Compiler compiler(fresh, arena);
+    size_t cached = 0, changed = 0;
+    for (const SourceLine &entry: lines) {
+        while (cached < raw.numbers.size() && raw.numbers[cached] < entry.number) cached++;
+        while (changed < dirty.size() && dirty[changed] < entry.number) changed++;
+        bool edited = changed < dirty.size() && dirty[changed] == entry.number;
+        if (!valid || edited || cached == raw.numbers.size() || raw.numbers[cached] != entry.number) {
+            compiler.add(entry);
+            counts.compiled++;
+            continue;
+        }
+        int begin = raw.starts[cached];
+        int end = cached + 1 < raw.starts.size() ? raw.starts[cached + 1] : int(raw.code.size());
+        fresh.numbers.push_back(entry.number);
+        fresh.starts.push_back(int(fresh.code.size()));
+        fresh.code.insert(fresh.code.end(), raw.code.begin() + begin, raw.code.begin() + end);
+        fresh.lines.insert(fresh.lines.end(), end - begin, entry.number);
+        counts.reused++;
+    }
+    raw = std::move(fresh);
+    dirty.clear();
+    valid = true;
+    image = raw;
+    Compiler(image, arena).link();
+    counts.builds++;
+    return true;
+}
+
+const CompileStats &CompileCache::stats() const {
+    return counts;
+}
+
+/*
+ * Implementation notes: ClosedLoop::run
+ * -------------------------------------
+ * After j iterations the counter holds c + j * d.  The loop stops
+ * after the first iteration that fails the test, which gives the
+ * number of iterations k; it is computed in 64 bits, and the loop is
+ * left to the VM if c + k * d does not fit in an int, because the
+ * counter would then wrap around and the test would see other values.
+ * An accumulator to which the body adds an induction variable v with
+ * step e grows by the sum of v + (j + a) * e over j < k, where a is 1
+ * if v changes before the accumulator in the body, which is
+ *
+ *    k * v + e * (k * (k - 1) / 2 + a * k).
+ *
+ * These sums and all final values are computed in unsigned 32-bit
+ * arithmetic, which wraps around like the step by step execution.
+ */
+
+bool ClosedLoop::run(int *values, char *defined) const {
+    for (int slot: reads) {
+        if (!defined[slot]) return false;
+    }
+    auto step = [&](const Induction &v) {
+        long long amount = v.constant ? v.step : values[v.step];
+        return v.negative ? -amount : amount;
+    };
+    long long first = values[inductions[counter].slot];
+    long long delta = step(inductions[counter]);
+    long long limit = constantBound ? bound : values[bound];
+    long long count;
+    if (test == OP_JUMP_LT) {
+        if (first + delta >= limit) count = 1;
+        else if (delta <= 0) return false;
+        else count = (limit - first + delta - 1) / delta;
+    } else {
+        if (first + delta <= limit) count = 1;
+        else if (delta >= 0) return false;
+        else count = (first - limit - delta - 1) / -delta;
+    }
+    long long last = first + count * delta;
+    if (last < INT_MIN || last > INT_MAX) return false;
+
+    auto k = uint32_t(count);
+    auto triangle = uint32_t(count % 2 == 0 ? count / 2 * (count - 1) : (count - 1) / 2 * count);
+    for (const Accumulator &sum: accumulators) {
+        const Induction &v = inductions[sum.induction];
+        uint32_t growth = k * uint32_t(values[v.slot]) + uint32_t(step(v)) * (triangle + (sum.after ? k : 0));
+        auto value = uint32_t(values[sum.slot]);
+        values[sum.slot] = int(sum.negative ? value - growth : value + growth);
+    }
+    for (const Induction &v: inductions) {
+        values[v.slot] = int(uint32_t(values[v.slot]) + k * uint32_t(step(v)));
+    }
+    return true;
+}
+
+/* Implementation of the VM class */
+
+/*
+ * Implementation notes: dispatch
+ * ------------------------------
+ * Addition, subtraction and multiplication are done in unsigned
+ * arithmetic, so that they wrap around modulo 2^32 by definition
+ * rather than by accident, as the native code and the closed loops
+ * do.  The body of the interpreter loop is written once in terms of
+ * three macros.  In the threaded build, run first translates every opcode
+ * into the address of its handler, and each handler ends by jumping
+ * straight to the handler of the next instruction, so there is no
+ * central loop and no bounds check at all.  In the portable build, the
+ * same handlers are the cases of a switch inside a loop.
+ */
+
+#if BASIC_THREADED_DISPATCH
+#define TARGET(op) L_##op
+#define DISPATCH() goto *threaded[pc++]
+#else
+#define TARGET(op) case op
+#define DISPATCH() continue
+#endif
+
+#define FETCH() (ins = &code[pc - 1])
+
+static inline int load(const int *values, const char *defined, int slot) {
+    if (!defined[slot]) error("VARIABLE NOT DEFINED");
+    return values[slot];
+}
+
+/* Reads the v/c operand of a superinstruction. */
+static inline int operand(const Instruction &ins, const int *values, const char *defined) {
+    return ins.op == OP_CONST ? ins.arg : load(values, defined, ins.arg);
+}
+
+/* Executes the LOAD; CONST; ADD/SUB; STORE prefix of an OP_STEP_JUMP sequence. */
+static inline int step(const Instruction *ins, int *values, char *defined) {
+    int value = load(values, defined, ins[0].arg);
+    value = int(ins[2].op == OP_ADD ? unsigned(value) + unsigned(ins[1].arg) : unsigned(value) - unsigned(ins[1].arg));
+    values[ins[3].arg] = value;
+    defined[ins[3].arg] = 1;
+    return value;
+}
+
+void VM::run(const Bytecode &image, EvalState &state, Output &output, int start) {
+    stack.assign(image.maxDepth + 1, 0);
+    int *values = state.valueData();
+    char *defined = state.definedData();
+    const Instruction *code = image.code.data();
+    const Instruction *ins;
+    int *sp = stack.data();
+    int pc = start;
+    int value;
+#if BASIC_THREADED_DISPATCH
+    static const void *const labels[] = {
+            &&L_OP_CONST, &&L_OP_LOAD, &&L_OP_STORE, &&L_OP_ASSIGN,
+            &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL, &&L_OP_DIV,
+            &&L_OP_PRINT, &&L_OP_INPUT,
+            &&L_OP_JUMP, &&L_OP_JUMP_EQ, &&L_OP_JUMP_LT, &&L_OP_JUMP_GT,
+            &&L_OP_END, &&L_OP_FAIL, &&L_OP_CLOSED_LOOP, &&L_OP_LOAD_DEFINED,
+            &&L_OP_ADD_CONST, &&L_OP_SUB_CONST, &&L_OP_MUL_CONST,
+            &&L_OP_JUMP_EQ_VAR, &&L_OP_JUMP_LT_VAR, &&L_OP_JUMP_GT_VAR,
+            &&L_OP_STEP_JUMP_EQ, &&L_OP_STEP_JUMP_LT, &&L_OP_STEP_JUMP_GT
+    };
+    handlers.resize(image.code.size());
+    for (size_t i = 0; i < image.code.size(); i++) {
+        handlers[i] = labels[code[i].op];
+    }
+    const void *const *threaded = handlers.data();
+    DISPATCH();
+#else
+    while (true) {
+        switch (code[pc++].op) {
+#endif
+    TARGET(OP_CONST):
+        FETCH();
+        *sp++ = ins->arg;
+        DISPATCH();
+    TARGET(OP_LOAD):
+        FETCH();
+        if (!defined[ins->arg]) error("VARIABLE NOT DEFINED");
+        *sp++ = values[ins->arg];
+        DISPATCH();
+    TARGET(OP_LOAD_DEFINED):
+        FETCH();
+        *sp++ = values[ins->arg];
+        DISPATCH();
+    TARGET(OP_STORE):
+        FETCH();
+        values[ins->arg] = *--sp;
+        defined[ins->arg] = 1;
+        DISPATCH();
+    TARGET(OP_ASSIGN):
+        FETCH();
+        values[ins->arg] = sp[-1];
+        defined[ins->arg] = 1;
+        DISPATCH();
+    TARGET(OP_ADD):
+        sp--;
+        sp[-1] = int(unsigned(sp[-1]) + unsigned(sp[0]));
+        DISPATCH();
+    TARGET(OP_SUB):
+        sp--;
+        sp[-1] = int(unsigned(sp[-1]) - unsigned(sp[0]));
+        DISPATCH();
+    TARGET(OP_MUL):
+        sp--;
+        sp[-1] = int(unsigned(sp[-1]) * unsigned(sp[0]));
+        DISPATCH();
+    TARGET(OP_DIV):
+        sp--;
+        if (sp[0] == 0) error("DIVIDE BY ZERO");
+        sp[-1] = sp[-1] / sp[0];
+        DISPATCH();
+    TARGET(OP_PRINT):
+        output.print(*--sp);
+        DISPATCH();
+    TARGET(OP_INPUT):
+        FETCH();
+        values[ins->arg] = Input::readValue(output);
+        defined[ins->arg] = 1;
+        DISPATCH();
+    TARGET(OP_JUMP):
+        FETCH();
+        pc = ins->arg;
+        DISPATCH();
+    TARGET(OP_JUMP_EQ):
+        FETCH();
+        sp -= 2;
+        if (sp[0] == sp[1]) pc = ins->arg;
+        DISPATCH();
+    TARGET(OP_JUMP_LT):
+        FETCH();
+        sp -= 2;
+        if (sp[0] < sp[1]) pc = ins->arg;
+        DISPATCH();
+    TARGET(OP_JUMP_GT):
+        FETCH();
+        sp -= 2;
+        if (sp[0] > sp[1]) pc = ins->arg;
+        DISPATCH();
+    TARGET(OP_END):
+        return;
+    TARGET(OP_FAIL):
+        FETCH();
+        error(image.messages[ins->arg]);
+        return;
+    TARGET(OP_CLOSED_LOOP):
+        FETCH();
+        if (image.loops[ins->arg].run(values, defined)) pc = image.loops[ins->arg].exit;
+        DISPATCH();
+    TARGET(OP_ADD_CONST):
+        FETCH();
+        values[ins[3].arg] = int(unsigned(load(values, defined, ins->arg)) + unsigned(ins[1].arg));
+        defined[ins[3].arg] = 1;
+        pc += 3;
+        DISPATCH();
+    TARGET(OP_SUB_CONST):
+        FETCH();
+        values[ins[3].arg] = int(unsigned(load(values, defined, ins->arg)) - unsigned(ins[1].arg));
+        defined[ins[3].arg] = 1;
+        pc += 3;
+        DISPATCH();
+    TARGET(OP_MUL_CONST):
+        FETCH();
+        values[ins[3].arg] = int(unsigned(load(values, defined, ins->arg)) * unsigned(ins[1].arg));
+        defined[ins[3].arg] = 1;
+        pc += 3;
+        DISPATCH();
+    TARGET(OP_JUMP_EQ_VAR):
+        FETCH();
+        pc = load(values, defined, ins->arg) == operand(ins[1], values, defined) ? ins[2].arg : pc + 2;
+        DISPATCH();
+    TARGET(OP_JUMP_LT_VAR):
+        FETCH();
+        pc = load(values, defined, ins->arg) < operand(ins[1], values, defined) ? ins[2].arg : pc + 2;
+        DISPATCH();
+    TARGET(OP_JUMP_GT_VAR):
+        FETCH();
+        pc = load(values, defined, ins->arg) > operand(ins[1], values, defined) ? ins[2].arg : pc + 2;
+        DISPATCH();
+    TARGET(OP_STEP_JUMP_EQ):
+        FETCH();
+        value = step(ins, values, defined);
+        pc = value == operand(ins[5], values, defined) ? ins[6].arg : pc + 6;
+        DISPATCH();
+    TARGET(OP_STEP_JUMP_LT):
+        FETCH();
+        value = step(ins, values, defined);
+        pc = value < operand(ins[5], values, defined) ? ins[6].arg : pc + 6;
+        DISPATCH();
+    TARGET(OP_STEP_JUMP_GT):
+        FETCH();
+        value = step(ins, values, defined);
+        pc = value > operand(ins[5], values, defined) ? ins[6].arg : pc + 6;
+        DISPATCH();
+#if !BASIC_THREADED_DISPATCH
+        }
+    }
+#endif
+}
+
+#undef FETCH
+#undef DISPATCH
+#undef TARGET
@@ -0,0 +1,379 @@
+/*
+ * File: vm.hpp
+ * ------------
+ * This interface exports the bytecode representation of a BASIC
+ * program, the Compiler that produces it from the parsed statements
+ * and the VM that executes it.  Compiling flattens every statement
+ * and expression tree of the program into a single instruction
+ * array in which jump targets are already resolved to instruction
+ * indices, so that RUN no longer needs any map lookups or virtual
+ * calls while the program is executing.
+ */
+
+#ifndef _vm_h
+#define _vm_h
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "evalstate.hpp"
+#include "exp.hpp"
+#include "linestore.hpp"
+#include "output.hpp"
+
+class Statement;
+
+/*
+ * Type: OpCode
+ * ------------
+ * The instruction set of the stack machine.  Expressions push their
+ * operands onto the value stack and the arithmetic instructions
+ * replace the two topmost values by their result.
+ *
+ *   OP_CONST   arg        push the constant arg
+ *   OP_LOAD    arg        push the variable in slot arg
+ *   OP_LOAD_DEFINED arg   the same, for a variable known to be defined
+ *   OP_STORE   arg        pop a value into slot arg
+ *   OP_ASSIGN  arg        store the top of stack into slot arg
+ *   OP_ADD .. OP_DIV      arithmetic on the two topmost values
+ *   OP_PRINT              pop and print a value
+ *   OP_INPUT   arg        read a value into slot arg
+ *   OP_JUMP    arg        continue at instruction arg
+ *   OP_JUMP_EQ/LT/GT arg  pop rhs and lhs, jump if lhs op rhs
+ *   OP_END                stop the program
+ *   OP_FAIL    arg        raise the error message number arg
+ *   OP_CLOSED_LOOP arg    run the counting loop number arg in closed
+ *                         form and leave it, or fall through into its
+ *                         body if that is not known to be exact
+ *
+ * The remaining opcodes are superinstructions, which the compiler's
+ * peephole pass writes over the OP_LOAD that begins a common sequence.
+ * The instructions of the sequence stay in place as the operands of
+ * the superinstruction, which executes all of them in one dispatch and
+ * continues after the last.  Operands marked v/c are an OP_LOAD or an
+ * OP_CONST.
+ *
+ *   OP_ADD_CONST .. OP_MUL_CONST    LOAD x; CONST c; ADD/SUB/MUL; STORE y
+ *   OP_JUMP_EQ_VAR .. _GT_VAR       LOAD x; v/c; JUMP_EQ/LT/GT
+ *   OP_STEP_JUMP_EQ .. _GT          LOAD x; CONST c; ADD/SUB; STORE x;
+ *                                   LOAD x; v/c; JUMP_EQ/LT/GT
+ */
+
+enum OpCode : unsigned char {
+    OP_CONST, OP_LOAD, OP_STORE, OP_ASSIGN,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV,
+    OP_PRINT, OP_INPUT,
+    OP_JUMP, OP_JUMP_EQ, OP_JUMP_LT, OP_JUMP_GT,
+    OP_END, OP_FAIL, OP_CLOSED_LOOP, OP_LOAD_DEFINED,
+    OP_ADD_CONST, OP_SUB_CONST, OP_MUL_CONST,
+    OP_JUMP_EQ_VAR, OP_JUMP_LT_VAR, OP_JUMP_GT_VAR,
+    OP_STEP_JUMP_EQ, OP_STEP_JUMP_LT, OP_STEP_JUMP_GT
+};
+
+/*
+ * Function: baseOf
+ * Usage: OpCode op = baseOf(ins.op);
+ * ----------------------------------
+ * Returns the instruction a superinstruction was written over, which
+ * is always OP_LOAD, and any other opcode unchanged.  Consumers that
+ * do not know the superinstructions can thus read the image as if the
+ * peephole pass had not run.
+ */
+
+inline OpCode baseOf(OpCode op) {
+    return op >= OP_ADD_CONST ? OP_LOAD : op;
+}
+
+struct Instruction {
+    OpCode op;
+    int arg;
+};
+
+/*
+ * Type: Induction
+ * ---------------
+ * A variable that the body of a counting loop changes by the same
+ * amount in every iteration, with LET V = V + STEP or LET V = V - STEP.
+ * The step is a constant or a variable the body does not assign.
+ */
+
+struct Induction {
+    int slot;
+    int step;                   /* The constant, or the slot of the step    */
+    bool constant;
+    bool negative;              /* Whether the step is subtracted           */
+};
+
+/*
+ * Type: Accumulator
+ * -----------------
+ * A variable to which the body of a counting loop adds the current
+ * value of an induction variable, or from which it subtracts it.
+ */
+
+struct Accumulator {
+    int slot;
+    int induction;              /* Index of the induction variable          */
+    bool negative;
+    bool after;                 /* Whether it sees the value of this round  */
+};
+
+/*
+ * Class: ClosedLoop
+ * -----------------
+ * A loop whose body consists only of LET statements over induction
+ * variables and accumulators and which is closed by an IF that
+ * compares one induction variable, the counter, with a constant or a
+ * variable the body does not assign.  Such a loop can be run in
+ * closed form: the number of iterations follows from the counter, its
+ * step and the bound, and the final values of all variables follow
+ * from the number of iterations.
+ */
+
+class ClosedLoop {
+
+public:
+
+    std::vector<Induction> inductions;
+    std::vector<Accumulator> accumulators;
+    std::vector<int> reads;     /* Slots the body or the test read          */
+    int counter = 0;            /* Index of the induction variable tested   */
+    OpCode test = OP_JUMP_LT;   /* The loop repeats while counter test bound */
+    int bound = 0;              /* The constant, or the slot of the bound   */
+    bool constantBound = true;
+    int exit = 0;               /* The instruction after the loop           */
+
+/*
+ * Method: run
+ * Usage: if (loop.run(values, defined)) ...
+ * -----------------------------------------
+ * Runs the whole loop on the slot arrays of an EvalState and returns
+ * true, or returns false and changes nothing if the result would not
+ * be the one of running it step by step: when a variable it reads is
+ * undefined, or when the counter would wrap around before the test
+ * fails.  The other variables wrap around modulo 2^32 exactly as the
+ * step by step execution does.
+ */
+
+    bool run(int *values, char *defined) const;
+
+};
+
+/*
+ * Class: Bytecode
+ * ---------------
+ * The compiled image of a program.  Variables are referred to by
+ * their EvalState slot numbers.
+ */
+
+class Bytecode {
+
+public:
+
+    std::vector<Instruction> code;
+    std::vector<int> lines;             /* Source line of each instruction */
+    std::vector<std::string> messages;  /* Operands of OP_FAIL             */
+    std::vector<int> starts;            /* First instruction of each line  */
+    std::vector<int> numbers;           /* Number of each line             */
+    std::vector<ClosedLoop> loops;      /* Operands of OP_CLOSED_LOOP      */
+    int maxDepth = 0;                   /* Deepest value stack needed      */
+
+    void clear();
+
+};
+
+/*
+ * Class: Compiler
+ * ---------------
+ * Translates the parsed statements of a program into Bytecode.  The
+ * statements and expressions emit their own instructions through the
+ * compile methods of Statement and ExpArena; the compiler
+ * keeps track of slots, stack depth and forward jumps.
+ */
+
+class Compiler {
+
+public:
+
+    Compiler(Bytecode &image, const ExpArena &arena);
+
+/*
+ * Method: compile
+ * Usage: compiler.compile(lines);
+ * -------------------------------
+ * Compiles a whole program, given as the line store kept by Program,
+ * which is the same as adding every line and linking the result.
+ */
+
+    void compile(LineStore &lines);
+
+/*
+ * Method: add
+ * Usage: compiler.add(line);
+ * --------------------------
+ * Appends the code of one line, which must come after every line
+ * already in the image.  Its jumps still name the line numbers they
+ * go to until the image is linked.
+ */
+
+    void add(const SourceLine &line);
+
+/*
+ * Method: link
+ * Usage: compiler.link();
+ * -----------------------
+ * Completes an image built with add: appends the final OP_END,
+ * resolves the jumps to the first instructions of their lines and
+ * runs the optimizing passes.  Jumps to line numbers that do not exist
+ * are linked to an instruction that raises LINE NUMBER ERROR when it
+ * is reached, which is the moment the tree walker reports it as well.
+ */
+
+    void link();
+
+    void emit(OpCode op, int arg = 0);
+
+    void emitJump(OpCode op, int lineNumber);
+
+    void emitFail(const std::string &message);
+
+/*
+ * Method: expression
+ * Usage: compiler.expression(exp);
+ * ---------------------------------
+ * Emits the code for the expression rooted at arena node exp.
+ */
+
+    void expression(int exp);
+
+private:
+
+    Bytecode &image;
+    const ExpArena &arena;
+    int line = -1;
+    int depth = 0;
+
+    void closeLoops();
+
+    bool analyze(int head, int jump, ClosedLoop &loop);
+
+    void fuse();
+
+};
+
+/*
+ * Type: CompileStats
+ * ------------------
+ * Counts the work a CompileCache has done.
+ */
+
+struct CompileStats {
+    int builds = 0;             /* Images built                             */
+    int hits = 0;               /* Requests that found the image up to date */
+    long long compiled = 0;     /* Lines compiled                           */
+    long long reused = 0;       /* Lines whose cached code was reused       */
+};
+
+/*
+ * Class: CompileCache
+ * -------------------
+ * Keeps the unlinked code of every line between compilations, so that
+ * editing a few lines of a large program and running it again only
+ * compiles the lines that were edited.  Program reports every line it
+ * adds, replaces or removes through invalidate.
+ */
+
+class CompileCache {
+
+public:
+
+/*
+ * Method: invalidate
+ * Usage: cache.invalidate(lineNumber);
+ * ------------------------------------
+ * Records that the line with the specified number was added, replaced
+ * or removed since the last update.
+ */
+
+    void invalidate(int lineNumber);
+
+/*
+ * Method: clear
+ * Usage: cache.clear();
+ * ---------------------
+ * Forgets all cached code, so that the next update compiles every
+ * line.  This is needed whenever the variable slots are reassigned.
+ */
+
+    void clear();
+
+/*
+ * Method: update
+ * Usage: if (cache.update(lines, arena, image)) ...
+ * ------------------------------------------------
+ * Brings the image up to date with the lines of the program and
+ * returns true, or returns false without touching the image if no
+ * line has changed since the previous update.  The image must not
+ * have been changed by anyone else in between.
+ */
+
+    bool update(LineStore &lines, const ExpArena &arena, Bytecode &image);
+
+    const CompileStats &stats() const;
+
+private:
+
+    Bytecode raw;                       /* Unlinked code of all lines      */
+    std::vector<int> dirty;
+    bool valid = false;
+    CompileStats counts;
+
+};
+
+/*
+ * Macro: BASIC_THREADED_DISPATCH
+ * ------------------------------
+ * Selects the direct-threaded dispatch loop, which needs the labels as
+ * values extension of GCC and Clang.  Other compilers, or a build with
+ * -DBASIC_SWITCH_DISPATCH, use the portable switch loop instead.
+ */
+
+#if !defined(BASIC_SWITCH_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+#define BASIC_THREADED_DISPATCH 1
+#else
+#define BASIC_THREADED_DISPATCH 0
+#endif
+
+/*
+ * Class: VM
+ * ---------
+ * Executes a Bytecode image directly on the slot arrays of an
+ * EvalState.
+ */
+
+class VM {
+
+public:
+
+/*
+ * Method: run
+ * Usage: vm.run(image, state, output);
+ *        vm.run(image, state, output, start);
+ * ------------------------------------------
+ * Executes the image from instruction start, which must be the first
+ * instruction of a line.
+ */
+
+    void run(const Bytecode &image, EvalState &state, Output &output, int start = 0);
+
+private:
+
+    std::vector<int> stack;
+
+#if BASIC_THREADED_DISPATCH
+    std::vector<const void *> handlers;     /* Handler address of each instruction */
+#endif
+
+};
+
+#endif
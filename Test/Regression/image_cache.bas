@@ -0,0 +1,22 @@
+10 REM A program loaded from a file, through the image cache when it runs with --cache
+40 LET B = A * (A + 2) - 7 / A
+20 LET A = 3
+30 LET Q = 0
+50 IF A < B THEN 70
+60 PRINT 60
+70 PRINT B + A
+80 INPUT C
+90 LET D = (C + 1) * (B - A) / (2 + A)
+100 PRINT D
+110 LET Q = Q + 1
+120 IF Q < 3 THEN 80
+130 GOTO 160
+140 PRINT 140
+150 PRINT 150
+160 PRINT Q * 1000 + D
+170 END
+this line is not BASIC
+180 LET = 2
+140
+150 PRINT 151
+30 LET Q = 1
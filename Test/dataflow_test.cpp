@@ -0,0 +1,141 @@
+/*
+ * File: dataflow_test.cpp
+ * -----------------------
+ * Checks the definite-assignment results that Program::definedAt
+ * reports to tooling: on straight-line code, across branches and
+ * loops, for variables defined before the analysis, after edits that
+ * have not been run yet and under every engine.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../Basic/program.hpp"
+
+static int failures = 0;
+
+static void enter(Program &program, const std::string &line) {
+    ParsedLine parsed = program.parse(line);
+    if (parsed.statement == nullptr) {
+        program.removeSourceLine(parsed.lineNumber);
+    } else {
+        program.addSourceLine(parsed.lineNumber, line, parsed.statement);
+    }
+}
+
+static void enterLines(Program &program, const std::vector<std::string> &lines) {
+    for (const std::string &line: lines) enter(program, line);
+}
+
+static std::string join(const std::vector<std::string> &names) {
+    std::string text = "{";
+    for (size_t i = 0; i < names.size(); i++) text += (i == 0 ? "" : ", ") + names[i];
+    return text + "}";
+}
+
+static void expect(Program &program, int lineNumber, const std::vector<std::string> &names,
+                   const std::string &context) {
+    std::vector<std::string> actual = program.definedAt(lineNumber);
+    if (actual != names) {
+        std::cerr << context << ": line " << lineNumber << " has " << join(actual)
+                  << " defined, expected " << join(names) << "\n";
+        failures++;
+    }
+}
+
+static void straightLine(Engine engine, const std::string &context) {
+    EvalState state;
+    Program program(state);
+    program.engine = engine;
+    enterLines(program, {"10 LET A = 1", "20 LET B = A + 1", "30 PRINT B", "40 END"});
+    expect(program, 10, {}, context);
+    expect(program, 20, {"A"}, context);
+    expect(program, 30, {"A", "B"}, context);
+    expect(program, 40, {"A", "B"}, context);
+    expect(program, 25, {}, context + " (missing line)");
+}
+
+static void branches(Engine engine, const std::string &context) {
+    EvalState state;
+    Program program(state);
+    program.engine = engine;
+    enterLines(program, {
+            "10 LET X = 1",
+            "20 IF X > 0 THEN 50",
+            "30 LET A = 1",
+            "40 GOTO 70",
+            "50 LET A = 2",
+            "60 LET B = 3",
+            "70 PRINT A",
+            "80 END",
+            "90 PRINT 0",
+    });
+    expect(program, 30, {"X"}, context);
+    expect(program, 60, {"X", "A"}, context);
+    expect(program, 70, {"X", "A"}, context);
+    expect(program, 90, {"X", "A", "B"}, context + " (unreachable)");
+}
+
+static void loops(Engine engine, const std::string &context) {
+    EvalState state;
+    Program program(state);
+    program.engine = engine;
+    enterLines(program, {
+            "10 LET I = 0",
+            "20 LET I = I + 1",
+            "30 LET S = I",
+            "40 IF I < 10 THEN 20",
+            "50 PRINT S",
+    });
+    expect(program, 20, {"I"}, context);
+    expect(program, 40, {"I", "S"}, context);
+    expect(program, 50, {"I", "S"}, context);
+}
+
+static void definedBefore(Engine engine, const std::string &context) {
+    EvalState state;
+    Program program(state);
+    program.engine = engine;
+    enterLines(program, {"10 PRINT Z", "20 LET Y = Z"});
+    expect(program, 10, {}, context);
+    state.setValue("Z", 5);
+    enter(program, "30 PRINT Y");
+    expect(program, 10, {"Z"}, context + " (after LET Z)");
+    expect(program, 30, {"Z", "Y"}, context + " (after LET Z)");
+}
+
+static void edits(Engine engine, const std::string &context) {
+    EvalState state;
+    Program program(state);
+    program.engine = engine;
+    enterLines(program, {"10 LET A = 1", "20 LET B = 2", "30 PRINT A"});
+    expect(program, 30, {"A", "B"}, context);
+    enter(program, "20 PRINT 2");
+    expect(program, 30, {"A"}, context + " (replaced line)");
+    enter(program, "10");
+    expect(program, 30, {}, context + " (removed line)");
+    enter(program, "5 LET B = 0");
+    expect(program, 30, {"B"}, context + " (added line)");
+    program.Clear();
+    expect(program, 30, {}, context + " (cleared)");
+}
+
+int main() {
+    struct {
+        const char *name;
+        Engine engine;
+    } engines[] = {{"tree", TREE_ENGINE}, {"vm", VM_ENGINE}, {"jit", JIT_ENGINE}, {"tiered", TIERED_ENGINE}};
+    for (const auto &engine: engines) {
+        std::string name = engine.name;
+        straightLine(engine.engine, name + " straight line");
+        branches(engine.engine, name + " branches");
+        loops(engine.engine, name + " loops");
+        definedBefore(engine.engine, name + " defined before");
+        edits(engine.engine, name + " edits");
+    }
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+    return 0;
+}
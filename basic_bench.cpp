@@ -0,0 +1,342 @@
+/*
+ * File: basic_bench.cpp
+ * ---------------------
+ * Microbenchmarks for the parts of the interpreter that decide its
+ * speed: lexing a line, parsing and evaluating expressions, looking up
+ * variables and running whole programs on each engine.  Every
+ * benchmark reports the time and the heap allocations per operation,
+ * where an operation is what its name says: one line lexed, one
+ * expression parsed or evaluated, one lookup, one loop iteration or,
+ * for the closed-form loops, one RUN.
+ * The inputs are fixed, so runs on the same machine are comparable;
+ * --json prints the results in a form meant for tracking them over
+ * time.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Basic/exp.hpp"
+#include "Basic/memstats.hpp"
+#include "Basic/parser.hpp"
+#include "Basic/program.hpp"
+#include "Basic/Utils/lexer.hpp"
+#include "Basic/Utils/tokenScanner.hpp"
+
+/*
+ * Type: Benchmark
+ * ---------------
+ * A named benchmark.  run performs n batches of unit operations each
+ * and returns a value computed from the results, which keeps the
+ * compiler from discarding the work.
+ */
+
+struct Benchmark {
+    std::string name;
+    std::function<long(long n)> run;
+    long unit = 1;
+};
+
+struct Measurement {
+    std::string name;
+    long operations;
+    double nanoseconds;                 /* Per operation */
+    double allocations;                 /* Per operation */
+    double bytes;                       /* Per operation */
+};
+
+static volatile long sink;
+
+/*
+ * Function: allocatedBytes
+ * Usage: long long bytes = allocatedBytes();
+ * ------------------------------------------
+ * Returns the bytes requested from the heap so far, as counted by the
+ * interpreter's own accounting in memstats.
+ */
+
+static long long allocatedBytes() {
+    long long total = 0;
+    for (int category = 0; category < MEMORY_CATEGORIES; category++) {
+        total += memoryCounters(MemoryCategory(category)).bytes;
+    }
+    return total;
+}
+
+/*
+ * Implementation notes: measure
+ * -----------------------------
+ * The operation count is doubled until one batch takes at least the
+ * minimum time, after which repeat batches of that size are timed and
+ * the fastest is reported, since interference only ever adds time.
+ */
+
+static Measurement measure(const Benchmark &benchmark, double minimum, int repeat) {
+    long n = 1;
+    while (true) {
+        auto start = std::chrono::steady_clock::now();
+        sink = benchmark.run(n);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed >= minimum || n >= (1L << 40)) break;
+        n *= elapsed * 8 < minimum ? 8 : 2;
+    }
+    Measurement best{benchmark.name, 0, 0, 0, 0};
+    for (int r = 0; r < repeat; r++) {
+        HeapStats before = heapStats();
+        long long bytes = allocatedBytes();
+        auto start = std::chrono::steady_clock::now();
+        sink = benchmark.run(n);
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        double operations = double(n) * benchmark.unit;
+        if (r == 0 || elapsed / operations < best.nanoseconds) {
+            best.nanoseconds = elapsed / operations;
+            best.allocations = double(heapStats().allocations - before.allocations) / operations;
+            best.bytes = double(allocatedBytes() - bytes) / operations;
+        }
+    }
+    best.operations = n * benchmark.unit;
+    return best;
+}
+
+/*
+ * Function: nested
+ * Usage: std::string text = nested(depth);
+ * ----------------------------------------
+ * Returns an expression over the variables A to E whose tree has the
+ * specified depth, alternating the four operators so that nothing can
+ * be folded away.
+ */
+
+static std::string nested(int depth) {
+    static const char operators[] = "+-*/";
+    std::string text = "A";
+    for (int i = 1; i < depth; i++) {
+        char variable = char('A' + i % 5);
+        char op = operators[i % 4];
+        if (op == '/') {
+            text = "(" + text + ") / " + variable;
+        } else {
+            text = variable + std::string(" ") + op + " (" + text + ")";
+        }
+    }
+    return text;
+}
+
+static const char *LINE = "100 IF total + i * 3 > limit - (j / 2) THEN 250";
+
+static void addLexerBenchmarks(std::vector<Benchmark> &benchmarks) {
+    benchmarks.push_back({"lex/lexer", [](long n) {
+        long tokens = 0;
+        Lexer lexer;
+        for (long i = 0; i < n; i++) {
+            lexer.setInput(LINE);
+            while (lexer.hasMoreTokens()) {
+                lexer.nextToken();
+                tokens++;
+            }
+        }
+        return tokens;
+    }});
+    benchmarks.push_back({"lex/token-scanner", [](long n) {
+        long tokens = 0;
+        TokenScanner scanner;
+        scanner.ignoreWhitespace();
+        scanner.scanNumbers();
+        for (long i = 0; i < n; i++) {
+            scanner.setInput(LINE);
+            while (scanner.hasMoreTokens()) {
+                scanner.nextToken();
+                tokens++;
+            }
+        }
+        return tokens;
+    }});
+}
+
+static void addExpressionBenchmarks(std::vector<Benchmark> &benchmarks) {
+    for (int depth: {1, 4, 16, 64}) {
+        std::string text = nested(depth);
+        benchmarks.push_back({"parse/depth-" + std::to_string(depth), [text](long n) {
+            EvalState state;
+            ExpArena arena(state);
+            long roots = 0;
+            for (long i = 0; i < n; i++) {
+                Lexer lexer(text);
+                roots += parseExp(lexer, arena);
+                arena.truncate(0);
+            }
+            return roots;
+        }});
+        benchmarks.push_back({"eval/depth-" + std::to_string(depth), [text](long n) {
+            EvalState state;
+            ExpArena arena(state);
+            Lexer lexer(text);
+            int root = parseExp(lexer, arena);
+            for (char variable = 'A'; variable <= 'E'; variable++) {
+                state.setValue(std::string(1, variable), variable - 'A' + 1);
+            }
+            long total = 0;
+            for (long i = 0; i < n; i++) {
+                total += arena.eval(root, state);
+            }
+            return total;
+        }});
+    }
+}
+
+static void addStateBenchmarks(std::vector<Benchmark> &benchmarks) {
+    for (int count: {10, 100, 1000, 10000}) {
+        benchmarks.push_back({"state/lookup-" + std::to_string(count), [count](long n) {
+            EvalState state;
+            std::vector<std::string> names;
+            for (int i = 0; i < count; i++) {
+                names.push_back("V" + std::to_string(i * 7919 % 100003));
+                state.setValue(names.back(), i);
+            }
+            long total = 0;
+            unsigned index = 12345;
+            for (long i = 0; i < n; i++) {
+                index = index * 1103515245 + 12345;
+                total += state.getValue(names[(index >> 8) % count]);
+            }
+            return total;
+        }});
+    }
+}
+
+/*
+ * Implementation notes: RUN benchmarks
+ * ------------------------------------
+ * The counting loop multiplies in its body, and the mixed loop divides
+ * and branches, so both stay on the ordinary dispatch path of every
+ * engine and measure the cost of one iteration.  A loop of the shape
+ * the VM runs in closed form would instead measure one evaluation of
+ * the formula per RUN, so it is reported separately, per RUN, on the
+ * engines that run it that way.  Each benchmark keeps one Program and
+ * runs it n times, so that the compile cost of the first RUN is spread
+ * over the operations like it is in a long session.
+ */
+
+static const int LOOP_COUNT = 100000;
+
+static void addRunBenchmarks(std::vector<Benchmark> &benchmarks) {
+    const std::vector<std::string> counting = {
+        "10 LET I = 0",
+        "20 LET S = 0",
+        "30 LET I = I + 1",
+        "40 LET S = S + I * 3",
+        "50 IF I < " + std::to_string(LOOP_COUNT) + " THEN 30",
+        "60 END",
+    };
+    const std::vector<std::string> closed = {
+        "10 LET I = 0",
+        "20 LET S = 0",
+        "30 LET I = I + 1",
+        "40 LET S = S + I",
+        "50 IF I < " + std::to_string(LOOP_COUNT) + " THEN 30",
+        "60 END",
+    };
+    const std::vector<std::string> mixed = {
+        "10 LET I = 0",
+        "20 LET S = 0",
+        "30 LET I = I + 1",
+        "40 LET S = S + I / 7",
+        "50 IF S < 1000 THEN 70",
+        "60 LET S = S - 1000",
+        "70 IF I < " + std::to_string(LOOP_COUNT) + " THEN 30",
+        "80 END",
+    };
+    struct {
+        const char *name;
+        Engine engine;
+    } engines[] = {{"tree", TREE_ENGINE}, {"vm", VM_ENGINE}, {"jit", JIT_ENGINE}, {"tiered", TIERED_ENGINE}};
+    auto run = [](const std::vector<std::string> &lines, Engine kind) {
+        return [lines, kind](long n) {
+            EvalState state;
+            Program basic(state);
+            basic.engine = kind;
+            for (const std::string &line: lines) {
+                ParsedLine parsed = basic.parse(line);
+                basic.addSourceLine(parsed.lineNumber, line, parsed.statement);
+            }
+            for (long r = 0; r < n; r++) basic.Run();
+            return long(state.getValue("S"));
+        };
+    };
+    for (const auto &program: {std::make_pair("counting", counting), std::make_pair("mixed", mixed)}) {
+        for (const auto &engine: engines) {
+            benchmarks.push_back({std::string("run/") + program.first + "/" + engine.name,
+                                  run(program.second, engine.engine), LOOP_COUNT});
+        }
+    }
+    benchmarks.push_back({"run/closed-form/vm", run(closed, VM_ENGINE)});
+    benchmarks.push_back({"run/closed-form/jit", run(closed, JIT_ENGINE)});
+}
+
+static void usage(const char *progname) {
+    std::cerr << "Usage: " << progname << " [--json] [--filter TEXT] [--min-time SECONDS] [--repeat N]\n"
+              << "    --json            Print the results as JSON\n"
+              << "    --filter TEXT     Run only the benchmarks whose names contain TEXT\n"
+              << "    --min-time S      Time batches of at least S seconds (default 0.2)\n"
+              << "    --repeat N        Report the fastest of N batches (default 3)\n";
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    enableMemoryAccounting();
+    bool json = false;
+    std::string filter;
+    double minimum = 0.2;
+    int repeat = 3;
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--json") {
+            json = true;
+        } else if (option == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (option == "--min-time" && i + 1 < argc) {
+            minimum = atof(argv[++i]);
+        } else if (option == "--repeat" && i + 1 < argc) {
+            repeat = std::max(1, atoi(argv[++i]));
+        } else {
+            usage(argv[0]);
+        }
+    }
+    std::vector<Benchmark> benchmarks;
+    addLexerBenchmarks(benchmarks);
+    addExpressionBenchmarks(benchmarks);
+    addStateBenchmarks(benchmarks);
+    addRunBenchmarks(benchmarks);
+
+    char line[256];
+    bool first = true;
+    if (json) {
+        std::cout << "[";
+    } else {
+        snprintf(line, sizeof(line), "%-24s %14s %12s %12s %14s\n", "benchmark", "ns/op", "allocs/op", "bytes/op", "operations");
+        std::cout << line;
+    }
+    for (const Benchmark &benchmark: benchmarks) {
+        if (benchmark.name.find(filter) == std::string::npos) continue;
+        Measurement m = measure(benchmark, minimum, repeat);
+        if (json) {
+            snprintf(line, sizeof(line),
+                     "%s\n  {\"name\": \"%s\", \"ns_per_op\": %.3f, \"allocs_per_op\": %.4f, "
+                     "\"bytes_per_op\": %.2f, \"operations\": %ld}",
+                     first ? "" : ",", m.name.c_str(), m.nanoseconds, m.allocations, m.bytes, m.operations);
+        } else {
+            snprintf(line, sizeof(line), "%-24s %14.3f %12.4f %12.2f %14ld\n",
+                     m.name.c_str(), m.nanoseconds, m.allocations, m.bytes, m.operations);
+        }
+        std::cout << line << std::flush;
+        first = false;
+    }
+    if (json) std::cout << "\n]\n";
+    return 0;
+}
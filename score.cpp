@@ -182,7 +182,7 @@ int main(int argc, char **argv) {
         /**************************************************************
          if you modify the structure of the files, you should modify the file paths here.
          **************************************************************/
-        system("g++ -o testcode Basic/Basic.cpp Basic/evalstate.cpp Basic/exp.cpp Basic/parser.cpp Basic/program.cpp Basic/statement.cpp Basic/Utils/error.cpp Basic/Utils/error.hpp Basic/Utils/tokenScanner.cpp Basic/Utils/tokenScanner.hpp Basic/Utils/strlib.cpp");
+        system("g++ -pthread -o testcode Basic/Basic.cpp Basic/evalstate.cpp Basic/exp.cpp Basic/parser.cpp Basic/program.cpp Basic/statement.cpp Basic/vm.cpp Basic/output.cpp Basic/loader.cpp Basic/imagecache.cpp Basic/linestore.cpp Basic/jit.cpp Basic/dataflow.cpp Basic/sampler.cpp Basic/memstats.cpp Basic/Utils/error.cpp Basic/Utils/error.hpp Basic/Utils/tokenScanner.cpp Basic/Utils/tokenScanner.hpp Basic/Utils/strlib.cpp Basic/Utils/lexer.cpp");
         if (traceFile.size()) runTest(traceFile);
         else {
             int i = 0;
@@ -0,0 +1,456 @@
+/*
+ * File: trace_runner.cpp
+ * ----------------------
+ * Runs the traces of the Test folder through the demo interpreter and
+ * through ours, in parallel, and reports per trace whether the outputs
+ * match together with the wall time and peak memory of both runs.
+ * Unlike score.cpp it uses no shell, temporary files or diff: every
+ * interpreter is started directly, fed its trace through a pipe and
+ * its output collected in memory, so any number of runs can proceed
+ * side by side.  Leak checking stays with score.cpp.
+ *
+ * With -r it runs the regression traces of a folder instead, which
+ * need no demo: each trace NAME.txt comes with the expected output
+ * NAME.out and optionally a program NAME.bas that is loaded with
+ * --load before the trace runs.  Every trace runs under each engine of
+ * our interpreter, and the traces with a program also through a cold,
+ * a warm and a damaged image cache.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static const std::string TRACE_FOLDER = "Test/";
+static const std::string DEFAULT_OURS = "./code";
+static const std::string DEFAULT_DEMO = "./Basic-Demo-64bit";
+
+/*
+ * Constant: ENGINES
+ * -----------------
+ * The options that select each way our interpreter can run a program.
+ * The tree walker comes first, since the other runs of a regression
+ * trace have to end in the same way as it does.  A tier threshold of
+ * one promotes every loop on its first back edge.
+ */
+
+static const std::vector<std::vector<std::string> > ENGINES = {
+        {"--tree"}, {"--vm"}, {"--jit"}, {}, {"--tier-threshold", "1"},
+};
+
+/*
+ * Type: RunResult
+ * ---------------
+ * The outcome of one interpreter run.  ok is false if the process
+ * could not be started, was killed by a signal or the time limit, or
+ * exited with a non-zero status.
+ */
+
+struct RunResult {
+    bool ok = false;
+    bool timedOut = false;
+    int status = -1;                    /* As returned by wait4 */
+    std::string output;
+    double milliseconds = 0;
+    long peakKilobytes = 0;
+};
+
+/*
+ * Type: TraceResult
+ * -----------------
+ * Both runs of one trace and the verdict: "pass", "fail" if the outputs
+ * differ, "error" if our run failed and "demo-error" if the demo's did.
+ * For a regression trace demo is the tree walker run, ours the first
+ * run that did not pass or else the last one, and options the options
+ * of that run; "error" then means that it ended differently from the
+ * tree walker run.
+ */
+
+struct TraceResult {
+    std::string trace;
+    std::string status;
+    RunResult demo;
+    RunResult ours;
+    std::string options;
+    int firstDifference = 0;            /* 1-based line, for "fail" */
+};
+
+static std::string readFile(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    return buffer.str();
+}
+
+/*
+ * Implementation notes: runInterpreter
+ * ------------------------------------
+ * The child gets the read end of one pipe as its standard input and
+ * the write end of another as its standard output; standard error is
+ * discarded.  The pipes are close-on-exec, so that no other child
+ * holds them open, and since creating a pipe and marking it cannot be
+ * done in one step portably, both happen while holding spawning, the
+ * lock that posix_spawn is called under as well.  The parent feeds the
+ * input and drains the output in a single poll loop, so that neither
+ * side can block the other however much is written, and kills the
+ * child at the deadline.  wait4 yields the peak resident set size of
+ * exactly this child.  A child that cannot be started keeps a status
+ * of -1.
+ */
+
+static std::mutex spawning;
+
+static bool closeOnExecPipe(int fds[2]) {
+    if (pipe(fds) != 0) return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+static RunResult runInterpreter(const std::string &program, const std::vector<std::string> &options,
+                                const std::string &input, double seconds) {
+    RunResult result;
+    std::vector<const char *> argv = {program.c_str()};
+    for (const std::string &option: options) argv.push_back(option.c_str());
+    argv.push_back(nullptr);
+    int in[2], out[2];
+    pid_t pid;
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(spawning);
+        if (!closeOnExecPipe(in)) return result;
+        if (!closeOnExecPipe(out)) {
+            close(in[0]);
+            close(in[1]);
+            return result;
+        }
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, in[0], 0);
+        posix_spawn_file_actions_adddup2(&actions, out[1], 1);
+        posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+        int error = posix_spawn(&pid, program.c_str(), &actions, nullptr,
+                                const_cast<char **>(argv.data()), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        close(in[0]);
+        close(out[1]);
+        if (error != 0) {
+            close(in[1]);
+            close(out[0]);
+            return result;
+        }
+    }
+    fcntl(in[1], F_SETFL, O_NONBLOCK);
+    auto deadline = start + std::chrono::duration<double>(seconds);
+    size_t written = 0;
+    int writer = in[1];
+    if (input.empty()) {
+        close(writer);
+        writer = -1;
+    }
+    char buffer[65536];
+    while (true) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            kill(pid, SIGKILL);
+            result.timedOut = true;
+            break;
+        }
+        pollfd fds[2] = {{out[0], POLLIN, 0}, {writer, POLLOUT, 0}};
+        int wait = int(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count()) + 1;
+        if (poll(fds, writer >= 0 ? 2 : 1, wait) < 0) {
+            if (errno == EINTR) continue;
+            kill(pid, SIGKILL);
+            break;
+        }
+        if (writer >= 0 && fds[1].revents != 0) {
+            ssize_t n = write(writer, input.data() + written, input.size() - written);
+            if (n > 0) written += n;
+            if ((n < 0 && errno != EAGAIN) || written == input.size()) {
+                close(writer);
+                writer = -1;
+            }
+        }
+        if (fds[0].revents != 0) {
+            ssize_t n = read(out[0], buffer, sizeof(buffer));
+            if (n > 0) {
+                result.output.append(buffer, n);
+            } else if (n == 0 || errno != EINTR) {
+                break;
+            }
+        }
+    }
+    if (writer >= 0) close(writer);
+    close(out[0]);
+    int status = 0;
+    rusage usage{};
+    while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR) {}
+    result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    result.peakKilobytes = usage.ru_maxrss;
+    result.status = status;
+    result.ok = !result.timedOut && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    return result;
+}
+
+static int firstDifference(const std::string &a, const std::string &b) {
+    auto mismatch = std::mismatch(a.begin(), a.begin() + std::min(a.size(), b.size()), b.begin());
+    return 1 + int(std::count(a.begin(), mismatch.first, '\n'));
+}
+
+static TraceResult runTrace(const std::string &trace, const std::string &demo,
+                            const std::string &ours, double seconds) {
+    TraceResult result;
+    result.trace = trace;
+    std::string input = readFile(trace);
+    result.demo = runInterpreter(demo, {}, input, seconds);
+    result.ours = runInterpreter(ours, {}, input, seconds);
+    if (!result.demo.ok) {
+        result.status = "demo-error";
+    } else if (!result.ours.ok) {
+        result.status = "error";
+    } else if (result.demo.output != result.ours.output) {
+        result.status = "fail";
+        result.firstDifference = firstDifference(result.demo.output, result.ours.output);
+    } else {
+        result.status = "pass";
+    }
+    return result;
+}
+
+static bool hasSuffix(const std::string &name, const std::string &suffix) {
+    return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/*
+ * Implementation notes: runRegression
+ * -----------------------------------
+ * Each run must end like the tree walker run, with the same exit
+ * status or signal, and print exactly the expected output, so a trace
+ * can also pin down a crash such as the trap of INT_MIN / -1.  The
+ * cache runs get a directory of their own below cache, which is empty
+ * before the cold run.  Before the last of them the final byte of
+ * every image is changed, which alters the text of the last line
+ * without touching the structure, so that only the checksum can tell
+ * the image is damaged.
+ */
+
+static void damageImages(const std::string &directory) {
+    DIR *dir = opendir(directory.c_str());
+    if (dir == nullptr) return;
+    while (dirent *entry = readdir(dir)) {
+        std::string path = directory + "/" + entry->d_name;
+        if (!hasSuffix(path, ".bimg")) continue;
+        int fd = open(path.c_str(), O_RDWR);
+        if (fd < 0) continue;
+        off_t end = lseek(fd, 0, SEEK_END);
+        char byte;
+        if (end > 0 && pread(fd, &byte, 1, end - 1) == 1) {
+            byte ^= 1;
+            if (pwrite(fd, &byte, 1, end - 1) != 1) perror(path.c_str());
+        }
+        close(fd);
+    }
+    closedir(dir);
+}
+
+static TraceResult runRegression(const std::string &trace, const std::string &ours,
+                                 double seconds, const std::string &cache) {
+    TraceResult result;
+    result.trace = trace;
+    std::string stem = trace.substr(0, trace.size() - 4);
+    std::string input = readFile(trace);
+    std::string expected = readFile(stem + ".out");
+    std::vector<std::string> load;
+    if (access((stem + ".bas").c_str(), R_OK) == 0) load = {"--load", stem + ".bas"};
+    std::vector<std::vector<std::string> > runs;
+    std::string directory = cache + "/" + stem.substr(stem.rfind('/') + 1);
+    for (const std::vector<std::string> &engine: ENGINES) {
+        runs.push_back(engine);
+        runs.back().insert(runs.back().end(), load.begin(), load.end());
+    }
+    if (!load.empty()) {
+        std::vector<std::string> cached = {"--cache", directory, "--load", stem + ".bas"};
+        runs.push_back(cached);
+        runs.push_back(cached);
+        runs.push_back(cached);
+    }
+    result.status = "pass";
+    for (size_t i = 0; i < runs.size(); i++) {
+        if (!load.empty() && i + 1 == runs.size()) damageImages(directory);
+        RunResult run = runInterpreter(ours, runs[i], input, seconds);
+        if (i == 0) result.demo = run;
+        result.ours = run;
+        result.options.clear();
+        for (const std::string &option: runs[i]) result.options += (result.options.empty() ? "" : " ") + option;
+        if (run.timedOut || run.status < 0 || run.status != result.demo.status) {
+            result.status = "error";
+        } else if (run.output != expected) {
+            result.status = "fail";
+            result.firstDifference = firstDifference(expected, run.output);
+        }
+        if (result.status != "pass") break;
+    }
+    return result;
+}
+
+static std::vector<std::string> findTraces(const std::string &folder, const std::string &prefix) {
+    std::vector<std::string> traces;
+    DIR *dir = opendir(folder.c_str());
+    if (dir == nullptr) return traces;
+    while (dirent *entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.rfind(prefix, 0) == 0 && name.size() > 4 && hasSuffix(name, ".txt")) {
+            traces.push_back(folder + name);
+        }
+    }
+    closedir(dir);
+    std::sort(traces.begin(), traces.end());
+    return traces;
+}
+
+static void printTable(const std::vector<TraceResult> &results, bool json) {
+    char line[512];
+    if (json) {
+        std::cout << "[\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            const TraceResult &r = results[i];
+            snprintf(line, sizeof(line),
+                     "  {\"trace\": \"%s\", \"status\": \"%s\", \"demo_ms\": %.3f, \"demo_peak_kb\": %ld, "
+                     "\"ours_ms\": %.3f, \"ours_peak_kb\": %ld, \"first_difference\": %d, \"options\": \"%s\"}%s\n",
+                     r.trace.c_str(), r.status.c_str(), r.demo.milliseconds, r.demo.peakKilobytes,
+                     r.ours.milliseconds, r.ours.peakKilobytes, r.firstDifference, r.options.c_str(),
+                     i + 1 < results.size() ? "," : "");
+            std::cout << line;
+        }
+        std::cout << "]\n";
+        return;
+    }
+    std::cout << "trace\tstatus\tdemo_ms\tdemo_peak_kb\tours_ms\tours_peak_kb\tfirst_difference\toptions\n";
+    for (const TraceResult &r: results) {
+        snprintf(line, sizeof(line), "%s\t%s\t%.3f\t%ld\t%.3f\t%ld\t%d\t%s\n",
+                 r.trace.c_str(), r.status.c_str(), r.demo.milliseconds, r.demo.peakKilobytes,
+                 r.ours.milliseconds, r.ours.peakKilobytes, r.firstDifference, r.options.c_str());
+        std::cout << line;
+    }
+}
+
+/*
+ * Function: removeTree
+ * Usage: removeTree(path);
+ * ------------------------
+ * Deletes a directory together with everything in it.
+ */
+
+static void removeTree(const std::string &path) {
+    if (DIR *dir = opendir(path.c_str())) {
+        while (dirent *entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..") removeTree(path + "/" + name);
+        }
+        closedir(dir);
+        rmdir(path.c_str());
+    } else {
+        unlink(path.c_str());
+    }
+}
+
+static void usage(const char *progname) {
+    std::cerr << "Usage: " << progname << " [-e OURS] [-s DEMO] [-r FOLDER] [-t TRACE]... [-j JOBS] [-T SECONDS] [-J] [-q]\n"
+              << "    -e  Our interpreter, default " << DEFAULT_OURS << "\n"
+              << "    -s  Demo interpreter, default " << DEFAULT_DEMO << "\n"
+              << "    -r  Run the regression traces FOLDER/*.txt under every engine, without the demo\n"
+              << "    -t  Run the specified trace instead of every " << TRACE_FOLDER << "trace*.txt\n"
+              << "    -j  Number of traces run at once, default one per hardware thread\n"
+              << "    -T  Time limit of each run in seconds, default 1\n"
+              << "    -J  Print the table as JSON instead of tab-separated values\n"
+              << "    -q  Print the summary only\n"
+              << "The exit status is 0 if every trace passed.\n";
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    std::string ours = DEFAULT_OURS, demo = DEFAULT_DEMO, regression;
+    std::vector<std::string> traces;
+    int jobs = int(std::max(1u, std::thread::hardware_concurrency()));
+    double seconds = 1;
+    bool json = false, quiet = false;
+    int c;
+    while ((c = getopt(argc, argv, "e:s:r:t:j:T:Jqh")) != -1) {
+        switch (c) {
+            case 'e': ours = optarg; break;
+            case 's': demo = optarg; break;
+            case 'r': regression = std::string(optarg) + "/"; break;
+            case 't': traces.push_back(optarg); break;
+            case 'j': jobs = std::max(1, atoi(optarg)); break;
+            case 'T': seconds = atof(optarg); break;
+            case 'J': json = true; break;
+            case 'q': quiet = true; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind != argc || seconds <= 0) usage(argv[0]);
+    std::string folder = regression.empty() ? TRACE_FOLDER : regression;
+    if (traces.empty()) traces = findTraces(folder, regression.empty() ? "trace" : "");
+    if (traces.empty()) {
+        std::cerr << argv[0] << ": no traces found in " << folder << "\n";
+        return 2;
+    }
+    std::string cache;
+    if (!regression.empty()) {
+        char name[] = "/tmp/trace_runner.XXXXXX";
+        if (mkdtemp(name) == nullptr) {
+            std::cerr << argv[0] << ": cannot create a cache directory\n";
+            return 2;
+        }
+        cache = name;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<TraceResult> results(traces.size());
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < traces.size(); i = next++) {
+            results[i] = regression.empty() ? runTrace(traces[i], demo, ours, seconds)
+                                            : runRegression(traces[i], ours, seconds, cache);
+        }
+    };
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (int t = 1; t < std::min<int>(jobs, int(traces.size())); t++) pool.emplace_back(worker);
+    worker();
+    for (std::thread &thread: pool) thread.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!cache.empty()) removeTree(cache);
+
+    if (!quiet) printTable(results, json);
+    int passed = 0;
+    double demoTotal = 0, oursTotal = 0;
+    for (const TraceResult &r: results) {
+        if (r.status == "pass") passed++;
+        demoTotal += r.demo.milliseconds;
+        oursTotal += r.ours.milliseconds;
+    }
+    fprintf(stderr, "%d / %zu trace(s) passed in %.2f s (demo %.1f ms, ours %.1f ms in total)\n",
+            passed, results.size(), elapsed, demoTotal, oursTotal);
+    return passed == int(results.size()) ? 0 : 1;
+}